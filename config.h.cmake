@@ -86,6 +86,15 @@
 /* Define to 1 if you have the <winsock.h> and <io.h> header files. */
 #cmakedefine HAVE_WINSOCK_IO_H 1
 
+/* Define to 1 if you have the <pthread.h> header file. */
+#cmakedefine HAVE_PTHREAD_H 1
+
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#cmakedefine HAVE_SYS_MMAN_H 1
+
+/* Define to 1 if you have the `mmap' function. */
+#cmakedefine HAVE_MMAP 1
+
 /* Define to 1 if you have the `times' function. */
 #cmakedefine HAVE_TIMES 1
 
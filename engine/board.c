@@ -66,14 +66,99 @@ struct string_data {
   int mark;                        /* General purpose mark. */
 };
 
+/* Number of words in a bitmap with one bit per board position. */
+#define LIBERTY_BITMAP_WORDS ((BOARDMAX + 31) / 32)
+
 struct string_liberties_data {
   int list[MAX_LIBERTIES];         /* Coordinates of liberties. */
+  /* All liberties, however many they are, as a bitmap. */
+  unsigned int bits[LIBERTY_BITMAP_WORDS];
 };
 
 struct string_neighbors_data {
   int list[MAXCHAIN];              /* List of neighbor string numbers. */
 };
 
+/* There are two ways to undo the changes made by trymove(). By
+ * default every changed int is pushed on a change stack together
+ * with its address and every changed vertex on a vertex stack, and
+ * popgo() writes the old values back one by one. Alternatively, with
+ * SNAPSHOT_UNDO, each stack level keeps a snapshot of the board,
+ * string number and stone arrays, which are bulk copied back by
+ * popgo(), while a string record is copied the first time it is
+ * changed at a level.
+ *
+ * The snapshots only cover the part of the arrays used by the current
+ * board size, so they are smallest for builds with a small MAX_BOARD.
+ * Even so the trymove_benchmark GTP command measured them 30-50%
+ * slower than the change stack for MAX_BOARD=9, and more for larger
+ * boards, so they must be asked for with CFLAGS=-DSNAPSHOT_UNDO=1.
+ */
+#ifndef SNAPSHOT_UNDO
+#define SNAPSHOT_UNDO 0
+#endif
+
+#if SNAPSHOT_UNDO
+
+/* A string record as it was before it was first changed at the
+ * current stack level. The neighbor list follows on a separate stack.
+ */
+struct saved_string {
+  int number;
+  struct string_data data;
+  struct string_liberties_data libs;
+};
+
+/* Everything besides the strings, as it was when a stack level was
+ * entered.
+ */
+struct board_snapshot {
+  Intersection board[BOARDSIZE];
+  int string_number[BOARDMAX];
+  int next_stone[BOARDMAX];
+  int next_string;
+  int board_ko_pos;
+  int black_captured;
+  int white_captured;
+  int komaster;
+  int kom_pos;
+  struct saved_string *saved_strings;
+  int *saved_neighbors;
+};
+
+/* On average a move changes fewer than five old strings. The sizes
+ * have the same kind of safety margin as STACK_SIZE below, but an
+ * overflow is caught in save_string().
+ */
+#define SAVED_STRINGS_SIZE (20 * MAXSTACK)
+#define SAVED_NEIGHBORS_SIZE (80 * MAXSTACK)
+
+#define CLEAR_STACKS() do { \
+  snapshot_pointer = snapshot_stack; \
+  saved_strings_pointer = saved_strings; \
+  saved_neighbors_pointer = saved_neighbors; \
+} while (0)
+
+#define BEGIN_CHANGE_RECORD() begin_snapshot()
+
+/* The board arrays and the scalars are in the snapshot. */
+#define PUSH_VALUE(v) ((void) 0)
+#define PUSH_VERTEX(v) ((void) 0)
+
+/* Copy string s unless already done at this stack level. */
+#define SAVE_STRING(s)\
+  (string_stamp[s] != snapshot_serial ? save_string(s) : (void) 0)
+
+#define PUSH_STRING_VALUE(s, v) SAVE_STRING(s)
+#define PUSH_LIBERTY_WORD(s, pos) SAVE_STRING(s)
+/* update_liberties() has saved the string before it changes it. */
+#define PUSH_OLD_LIBERTY_WORD(s, k, old) SAVE_STRING(s)
+
+#define POP_MOVE() restore_snapshot()
+#define POP_VERTICES() ((void) 0)
+
+#else
+
 /* we keep the address and the old value */
 struct change_stack_entry {
   int *address;
@@ -88,9 +173,11 @@ struct vertex_stack_entry {
 
 
 /* Experimental results show that the average number of change stack
- * entries per move usually is in the 20-30 range and very seldom
- * exceeds 40. But since we have no way to recover from running out of
- * stack space, we allocate with a substantial safety margin.
+ * entries per move, liberty bitmap words included, is below 20. A
+ * move which captures large strings may need a few hundred, but the
+ * deepest reading in the regression tests has used less than 3500
+ * entries in total. Since we have no way to recover from running out
+ * of stack space, we allocate with a substantial safety margin.
  */
 #define STACK_SIZE 80 * MAXSTACK
 
@@ -117,6 +204,21 @@ struct vertex_stack_entry {
 (vertex_stack_pointer->address = &(v),\
  (vertex_stack_pointer++)->value = (v))
 
+/* Save a value belonging to string s. */
+#define PUSH_STRING_VALUE(s, v) PUSH_VALUE(v)
+
+/* Save the word of the liberty bitmap of string s holding pos. */
+#define PUSH_LIBERTY_WORD(s, pos)\
+(change_stack_pointer->address = (int *) &string_libs[s].bits[(pos) / 32],\
+ (change_stack_pointer++)->value = (int) string_libs[s].bits[(pos) / 32])
+
+/* Save word k of the liberty bitmap of string s, which had the value
+ * old before it was changed.
+ */
+#define PUSH_OLD_LIBERTY_WORD(s, k, old)\
+(change_stack_pointer->address = (int *) &string_libs[s].bits[k],\
+ (change_stack_pointer++)->value = (int) (old))
+
 #define POP_MOVE()\
   while ((--change_stack_pointer)->address)\
   *(change_stack_pointer->address) =\
@@ -128,35 +230,56 @@ struct vertex_stack_entry {
   *(vertex_stack_pointer->address) =\
   vertex_stack_pointer->value
 
+#endif
+
 
 /* ================================================================ */
 /*                      static data structures                      */
 /* ================================================================ */
 
+/* Like the board itself, all of these are thread local. */
 
 /* Main array of string information. */
-static struct string_data string[MAX_STRINGS];
-static struct string_liberties_data string_libs[MAX_STRINGS];
-static struct string_neighbors_data string_neighbors[MAX_STRINGS];
+static BOARD_TLS struct string_data string[MAX_STRINGS];
+static BOARD_TLS struct string_liberties_data string_libs[MAX_STRINGS];
+static BOARD_TLS struct string_neighbors_data string_neighbors[MAX_STRINGS];
 
 /* Stacks and stack pointers. */
-static struct change_stack_entry change_stack[STACK_SIZE];
-static struct change_stack_entry *change_stack_pointer;
+#if SNAPSHOT_UNDO
+static BOARD_TLS struct board_snapshot snapshot_stack[MAXSTACK];
+static BOARD_TLS struct board_snapshot *snapshot_pointer;
+
+static BOARD_TLS struct saved_string saved_strings[SAVED_STRINGS_SIZE];
+static BOARD_TLS struct saved_string *saved_strings_pointer;
+
+static BOARD_TLS int saved_neighbors[SAVED_NEIGHBORS_SIZE];
+static BOARD_TLS int *saved_neighbors_pointer;
+
+/* A string has been saved at the current stack level if its stamp
+ * equals the serial number, which is renewed whenever the level
+ * changes.
+ */
+static BOARD_TLS unsigned int string_stamp[MAX_STRINGS];
+static BOARD_TLS unsigned int snapshot_serial;
+#else
+static BOARD_TLS struct change_stack_entry change_stack[STACK_SIZE];
+static BOARD_TLS struct change_stack_entry *change_stack_pointer;
 
-static struct vertex_stack_entry vertex_stack[STACK_SIZE];
-static struct vertex_stack_entry *vertex_stack_pointer;
+static BOARD_TLS struct vertex_stack_entry vertex_stack[STACK_SIZE];
+static BOARD_TLS struct vertex_stack_entry *vertex_stack_pointer;
+#endif
 
 
 /* Index into list of strings. The index is only valid if there is a
  * stone at the vertex.
  */
-static int string_number[BOARDMAX];
+static BOARD_TLS int string_number[BOARDMAX];
 
 
 /* The stones in a string are linked together in a cyclic list. 
  * These are the coordinates to the next stone in the string.
  */
-static int next_stone[BOARDMAX];
+static BOARD_TLS int next_stone[BOARDMAX];
 
 
 /* ---------------------------------------------------------------- */
@@ -253,11 +376,26 @@ static int next_stone[BOARDMAX];
 #define COUNTSTONES(pos) \
   string[string_number[pos]].size
 
+#define LIBERTY_BIT(pos) (1U << ((pos) % 32))
+
+#define SET_LIBERTY_BIT(s, pos)\
+  (string_libs[s].bits[(pos) / 32] |= LIBERTY_BIT(pos))
+
+#define CLEAR_LIBERTY_BIT(s, pos)\
+  (string_libs[s].bits[(pos) / 32] &= ~LIBERTY_BIT(pos))
+
+#define CLEAR_LIBERTY_BITS(s)\
+  memset(string_libs[s].bits, 0, sizeof(string_libs[s].bits))
+
+/* The liberty bitmap word of an existing string must be pushed before
+ * a liberty is added to it.
+ */
 #define ADD_LIBERTY(s, pos)\
   do {\
     if (string[s].liberties < MAX_LIBERTIES)\
       string_libs[s].list[string[s].liberties] = pos;\
     string[s].liberties++;\
+    SET_LIBERTY_BIT(s, pos);\
   } while (0)
 
 #define ADD_AND_MARK_LIBERTY(s, pos)\
@@ -265,6 +403,7 @@ static int next_stone[BOARDMAX];
     if (string[s].liberties < MAX_LIBERTIES)\
       string_libs[s].list[string[s].liberties] = pos;\
     string[s].liberties++;\
+    SET_LIBERTY_BIT(s, pos);\
     ml[pos] = liberty_mark;\
   } while (0)
 
@@ -285,31 +424,68 @@ static int next_stone[BOARDMAX];
     board[pos] = EMPTY;\
   } while (0)
 
+#define IS_LIBERTY_BIT_SET(s, pos)\
+  (string_libs[s].bits[(pos) / 32] & LIBERTY_BIT(pos))
+
 
 /* ---------------------------------------------------------------- */
 
 
 
 /* Number of the next free string. */
-static int next_string;
+static BOARD_TLS int next_string;
 
 
 /* For marking purposes. */
-static int ml[BOARDMAX];
-static int liberty_mark;
-static int string_mark;
+static BOARD_TLS int ml[BOARDMAX];
+static BOARD_TLS int liberty_mark;
+static BOARD_TLS int string_mark;
+
+
+/* When the move history is full, play_move() collapses its first
+ * moves into the initial position. The positions before those moves
+ * are kept in a chain of blocks for superko detection, so that
+ * restore_board() can rebuild the position set. A block is never
+ * changed once made, so stored board states, also those handed to
+ * other threads, share the chain. The blocks made by a thread are
+ * freed when it clears its move history.
+ */
+
+/* Number of moves collapsed at a time. */
+#define COLLAPSED_MOVES (1 + MAX_MOVE_HISTORY / 10)
+
+struct older_positions {
+  struct older_positions *previous;    /* Earlier positions, or NULL. */
+  struct older_positions *next_owned;  /* Next block made by the thread. */
+  int num_positions;
+  int color[COLLAPSED_MOVES];          /* Color to move. */
+  Hash_data hash[COLLAPSED_MOVES];
+};
+
+static BOARD_TLS struct older_positions *older_positions = NULL;
+static BOARD_TLS struct older_positions *owned_older_positions = NULL;
 
 
 /* Forward declarations. */
 static void really_do_trymove(int pos, int color);
 static int do_trymove(int pos, int color, int ignore_ko);
 static void undo_trymove(void);
+#if SNAPSHOT_UNDO
+static void begin_snapshot(void);
+static void save_string(int s);
+static void restore_snapshot(void);
+#endif
 
 static int do_approxlib(int pos, int color, int maxlib, int *libs);
 static int slow_approxlib(int pos, int color, int maxlib, int *libs);
 static int do_accuratelib(int pos, int color, int maxlib, int *libs);
 
 static int is_superko_violation(int pos, int color, enum ko_rules type);
+static void clear_position_set(void);
+static void add_position(Hash_data *hash, int color);
+static void forget_older_positions(void);
+
+static int list_liberty_bits(const unsigned int *bits, int maxlib, int *libs);
 
 static void new_position(void);
 static int propagate_string(int stone, int str);
@@ -318,11 +494,11 @@ static int do_remove_string(int s);
 static void do_commit_suicide(int pos, int color);
 static void do_play_move(int pos, int color);
 
-static int komaster, kom_pos;
+static BOARD_TLS int komaster, kom_pos;
 
 
 /* Statistics. */
-static int trymove_counter = 0;
+static BOARD_TLS int trymove_counter = 0;
 
 /* Coordinates for the eight directions, ordered
  * south, west, north, east, southwest, northwest, northeast, southeast.
@@ -338,6 +514,10 @@ int delta[8]  = { NS, -1, -NS, 1, NS-1, -NS-1, -NS+1, NS+1};
 
 /*
  * Save board state.
+ *
+ * The state shares the positions collapsed out of the move history
+ * with this thread, so it can only be restored until the move history
+ * is cleared here, by clear_board(), add_stone() or remove_stone().
  */
 
 void
@@ -366,6 +546,7 @@ store_board(struct board_state *state)
     state->move_history_pos[k] = move_history_pos[k];
     state->move_history_hash[k] = move_history_hash[k];
   }
+  state->older_positions = older_positions;
 
   state->komi = komi;
   state->handicap = handicap;
@@ -380,6 +561,7 @@ store_board(struct board_state *state)
 void
 restore_board(struct board_state *state)
 {
+  struct older_positions *block;
   int k;
 
   gg_assert(stackp == 0);
@@ -398,10 +580,16 @@ restore_board(struct board_state *state)
   initial_black_captured = state->initial_black_captured;
   
   move_history_pointer = state->move_history_pointer;
+  older_positions = state->older_positions;
+  clear_position_set();
+  for (block = older_positions; block; block = block->previous)
+    for (k = 0; k < block->num_positions; k++)
+      add_position(&block->hash[k], block->color[k]);
   for (k = 0; k < move_history_pointer; k++) {
     move_history_color[k] = state->move_history_color[k];
     move_history_pos[k] = state->move_history_pos[k];
     move_history_hash[k] = state->move_history_hash[k];
+    add_position(&move_history_hash[k], move_history_color[k]);
   }
 
   komi = state->komi;
@@ -445,6 +633,8 @@ clear_board(void)
   initial_black_captured = 0;
 
   move_history_pointer = 0;
+  forget_older_positions();
+  clear_position_set();
   movenum = 0;
 
   handicap = 0;
@@ -479,10 +669,10 @@ test_gray_border(void)
  * position and which color made them. Perhaps 
  * this should be one array of a structure 
  */
-static int stack[MAXSTACK];
-static int move_color[MAXSTACK];
+static BOARD_TLS int stack[MAXSTACK];
+static BOARD_TLS int move_color[MAXSTACK];
 
-static Hash_data board_hash_stack[MAXSTACK];
+static BOARD_TLS Hash_data board_hash_stack[MAXSTACK];
 
 /*
  * trymove pushes the position onto the stack, and makes a move
@@ -759,12 +949,14 @@ popgo()
 static void
 undo_trymove()
 {
+#if !SNAPSHOT_UNDO
   gg_assert(change_stack_pointer - change_stack <= STACK_SIZE);
 
   if (0) {
     gprintf("Change stack size = %d\n", change_stack_pointer - change_stack);
     gprintf("Vertex stack size = %d\n", vertex_stack_pointer - vertex_stack);
   }
+#endif
 
   POP_MOVE();
   POP_VERTICES();
@@ -774,6 +966,115 @@ undo_trymove()
 }
 
 
+#if SNAPSHOT_UNDO
+
+/* Renew the serial number which tells whether a string has already
+ * been saved at the current stack level.
+ */
+static void
+new_snapshot_serial(void)
+{
+  if (++snapshot_serial == 0) {
+    memset(string_stamp, 0, sizeof(string_stamp));
+    snapshot_serial = 1;
+  }
+}
+
+
+/* Enter a new stack level, taking a snapshot of the active part of
+ * the board arrays and of the scalars which may change in a move.
+ */
+static void
+begin_snapshot(void)
+{
+  struct board_snapshot *snapshot = snapshot_pointer++;
+  int n = POS(board_size - 1, board_size - 1) + 1;
+
+  memcpy(snapshot->board, board, n * sizeof(board[0]));
+  memcpy(snapshot->string_number, string_number, n * sizeof(string_number[0]));
+  memcpy(snapshot->next_stone, next_stone, n * sizeof(next_stone[0]));
+  snapshot->next_string = next_string;
+  snapshot->board_ko_pos = board_ko_pos;
+  snapshot->black_captured = black_captured;
+  snapshot->white_captured = white_captured;
+  snapshot->komaster = komaster;
+  snapshot->kom_pos = kom_pos;
+  snapshot->saved_strings = saved_strings_pointer;
+  snapshot->saved_neighbors = saved_neighbors_pointer;
+
+  new_snapshot_serial();
+}
+
+
+/* Save string s before it is changed for the first time at the
+ * current stack level. Strings created at this level and changes
+ * made outside of trymove() need not be saved.
+ */
+static void
+save_string(int s)
+{
+  struct saved_string *saved = saved_strings_pointer;
+  int neighbors = string[s].neighbors;
+
+  string_stamp[s] = snapshot_serial;
+  if (snapshot_pointer == snapshot_stack
+      || s >= snapshot_pointer[-1].next_string)
+    return;
+
+  gg_assert(saved < saved_strings + SAVED_STRINGS_SIZE);
+  gg_assert(saved_neighbors_pointer + neighbors
+	    <= saved_neighbors + SAVED_NEIGHBORS_SIZE);
+
+  saved->number = s;
+  saved->data = string[s];
+  saved->libs = string_libs[s];
+  saved_strings_pointer++;
+
+  memcpy(saved_neighbors_pointer, string_neighbors[s].list,
+	 neighbors * sizeof(string_neighbors[s].list[0]));
+  saved_neighbors_pointer += neighbors;
+}
+
+
+/* Leave the current stack level, restoring the saved strings and the
+ * snapshot. String marks are left as they are, just like with the
+ * change stack.
+ */
+static void
+restore_snapshot(void)
+{
+  struct board_snapshot *snapshot = --snapshot_pointer;
+  int n = POS(board_size - 1, board_size - 1) + 1;
+
+  while (saved_strings_pointer > snapshot->saved_strings) {
+    struct saved_string *saved = --saved_strings_pointer;
+    int s = saved->number;
+    int mark = string[s].mark;
+
+    saved_neighbors_pointer -= saved->data.neighbors;
+    string[s] = saved->data;
+    string[s].mark = mark;
+    string_libs[s] = saved->libs;
+    memcpy(string_neighbors[s].list, saved_neighbors_pointer,
+	   saved->data.neighbors * sizeof(string_neighbors[s].list[0]));
+  }
+
+  memcpy(board, snapshot->board, n * sizeof(board[0]));
+  memcpy(string_number, snapshot->string_number, n * sizeof(string_number[0]));
+  memcpy(next_stone, snapshot->next_stone, n * sizeof(next_stone[0]));
+  next_string = snapshot->next_string;
+  board_ko_pos = snapshot->board_ko_pos;
+  black_captured = snapshot->black_captured;
+  white_captured = snapshot->white_captured;
+  komaster = snapshot->komaster;
+  kom_pos = snapshot->kom_pos;
+
+  new_snapshot_serial();
+}
+
+#endif
+
+
 
 /*
  * dump_stack() for use under gdb prints the move stack. 
@@ -810,6 +1111,196 @@ do_dump_stack(void)
 /* ================================================================ */
 
 
+/* The positions which have occurred in the game are kept in a hash
+ * set for superko detection, so that it neither has to scan the move
+ * history nor is limited to it. As in move_history_hash[], the
+ * contributions of the ko positions are removed from the hashes. The
+ * set uses open addressing with linear probing. Since undo_move()
+ * must be able to take positions back, each entry counts how many
+ * times the position has occurred with each color to move. Entries
+ * are never removed, only their counts go down to zero, so that the
+ * probe sequences stay intact.
+ *
+ * The set starts out in a thread local array, which suffices for
+ * games of normal length, and moves to a doubled table on the heap
+ * when it gets half full.
+ */
+
+struct position_entry {
+  Hash_data hash;
+  int count[2];        /* Occurrences with WHITE and BLACK to move. */
+  int used;
+};
+
+#define POSITION_SET_INITIAL_SIZE 1024
+
+static BOARD_TLS struct position_entry
+  initial_position_set[POSITION_SET_INITIAL_SIZE];
+static BOARD_TLS struct position_entry *position_set = NULL;
+static BOARD_TLS int position_set_size;
+static BOARD_TLS int position_set_used;
+
+
+/* Forget all positions. */
+static void
+clear_position_set(void)
+{
+  if (position_set != initial_position_set) {
+    free(position_set);
+    position_set = initial_position_set;
+    position_set_size = POSITION_SET_INITIAL_SIZE;
+  }
+  memset(position_set, 0, position_set_size * sizeof(position_set[0]));
+  position_set_used = 0;
+}
+
+
+/* Free the memory of the position set and of the collapsed positions
+ * made by the calling thread. Threads which have used restore_board()
+ * call this before they exit, since the thread local pointers to the
+ * memory go away with them.
+ */
+void
+free_board_state(void)
+{
+  forget_older_positions();
+  if (position_set != initial_position_set)
+    free(position_set);
+  position_set = NULL;
+  position_set_size = 0;
+  position_set_used = 0;
+}
+
+
+/* Find the entry for the position with the given hash, or the empty
+ * entry where it would be added.
+ */
+static struct position_entry *
+find_position(Hash_data *hash)
+{
+  int k = hashdata_remainder(*hash, position_set_size);
+
+  while (position_set[k].used
+	 && !hashdata_is_equal(position_set[k].hash, *hash))
+    k = (k + 1) & (position_set_size - 1);
+
+  return &position_set[k];
+}
+
+
+/* Double the size of the position set, dropping the entries which no
+ * longer count any occurrences. If there is not enough memory we just
+ * keep the old table.
+ */
+static void
+grow_position_set(void)
+{
+  struct position_entry *old_set = position_set;
+  int old_size = position_set_size;
+  struct position_entry *new_set;
+  int k;
+
+  new_set = calloc(2 * old_size, sizeof(new_set[0]));
+  if (new_set == NULL)
+    return;
+
+  position_set = new_set;
+  position_set_size = 2 * old_size;
+  position_set_used = 0;
+  for (k = 0; k < old_size; k++)
+    if (old_set[k].count[0] + old_set[k].count[1] > 0) {
+      *find_position(&old_set[k].hash) = old_set[k];
+      position_set_used++;
+    }
+
+  if (old_set != initial_position_set)
+    free(old_set);
+}
+
+
+/* Record an occurrence of the position with the given hash and color
+ * to move.
+ */
+static void
+add_position(Hash_data *hash, int color)
+{
+  struct position_entry *entry;
+
+  if (position_set == NULL)
+    clear_position_set();
+
+  if (2 * (position_set_used + 1) > position_set_size)
+    grow_position_set();
+
+  entry = find_position(hash);
+  if (!entry->used) {
+    /* Always keep an empty entry to end the probe sequences. */
+    if (position_set_used + 1 >= position_set_size)
+      return;
+    entry->hash = *hash;
+    entry->used = 1;
+    position_set_used++;
+  }
+  entry->count[color - 1]++;
+}
+
+
+/* Keep the positions before the first n moves of the move history,
+ * which are about to be collapsed. If there is not enough memory they
+ * are only lost for restore_board().
+ */
+static void
+keep_older_positions(int n)
+{
+  struct older_positions *block = malloc(sizeof(*block));
+  int k;
+
+  gg_assert(n <= COLLAPSED_MOVES);
+  if (block == NULL)
+    return;
+
+  for (k = 0; k < n; k++) {
+    block->color[k] = move_history_color[k];
+    block->hash[k] = move_history_hash[k];
+  }
+  block->num_positions = n;
+  block->previous = older_positions;
+  block->next_owned = owned_older_positions;
+  older_positions = block;
+  owned_older_positions = block;
+}
+
+
+/* Drop the collapsed positions and free the blocks made by this
+ * thread.
+ */
+static void
+forget_older_positions(void)
+{
+  while (owned_older_positions) {
+    struct older_positions *block = owned_older_positions;
+    owned_older_positions = block->next_owned;
+    free(block);
+  }
+  older_positions = NULL;
+}
+
+
+/* Take back an occurrence recorded by add_position(). */
+static void
+remove_position(Hash_data *hash, int color)
+{
+  struct position_entry *entry;
+
+  if (position_set == NULL)
+    return;
+
+  entry = find_position(hash);
+  if (entry->used && entry->count[color - 1] > 0)
+    entry->count[color - 1]--;
+}
+
+
 static void
 reset_move_history(void)
 {
@@ -818,6 +1309,8 @@ reset_move_history(void)
   initial_white_captured = white_captured;
   initial_black_captured = black_captured;
   move_history_pointer = 0;
+  forget_older_positions();
+  clear_position_set();
 }
 
 /* Place a stone on the board and update the board_hash. This operation
@@ -947,14 +1440,16 @@ play_move(int pos, int color)
     /* The move history is full. We resolve this by collapsing the
      * first about 10% of the moves into the initial position.
      */
-    int number_collapsed_moves = 1 + MAX_MOVE_HISTORY / 10;
+    int number_collapsed_moves = COLLAPSED_MOVES;
     int k;
     Intersection saved_board[BOARDSIZE];
     int saved_board_ko_pos = board_ko_pos;
     int saved_white_captured = white_captured;
     int saved_black_captured = black_captured;
+    Hash_data saved_board_hash = board_hash;
     memcpy(saved_board, board, sizeof(board));
 
+    keep_older_positions(number_collapsed_moves);
     replay_move_history(number_collapsed_moves);
 
     memcpy(initial_board, board, sizeof(board));
@@ -973,6 +1468,7 @@ play_move(int pos, int color)
     board_ko_pos = saved_board_ko_pos;
     white_captured = saved_white_captured;
     black_captured = saved_black_captured;
+    board_hash = saved_board_hash;
     new_position();
   }
 
@@ -981,6 +1477,7 @@ play_move(int pos, int color)
   move_history_hash[move_history_pointer] = board_hash;
   if (board_ko_pos != NO_MOVE)
     hashdata_invert_ko(&move_history_hash[move_history_pointer], board_ko_pos);
+  add_position(&move_history_hash[move_history_pointer], color);
   move_history_pointer++;
   
   play_move_no_history(pos, color, 1);
@@ -995,12 +1492,17 @@ play_move(int pos, int color)
 int
 undo_move(int n)
 {
+  int k;
+
   gg_assert(stackp == 0);
   
   /* Fail if and only if the move history is too short. */
   if (move_history_pointer < n)
     return 0;
 
+  for (k = move_history_pointer - n; k < move_history_pointer; k++)
+    remove_position(&move_history_hash[k], move_history_color[k]);
+
   replay_move_history(move_history_pointer - n);
   move_history_pointer -= n;
   movenum -= n;
@@ -1522,6 +2024,65 @@ countlib(int str)
 }
 
 
+/* Number of set bits in a word of a liberty bitmap. */
+static int
+popcount(unsigned int x)
+{
+#ifdef __GNUC__
+  return __builtin_popcount(x);
+#else
+  int n = 0;
+  for (; x != 0; x &= x - 1)
+    n++;
+  return n;
+#endif
+}
+
+
+/* Position of the lowest set bit in a nonzero word of a liberty
+ * bitmap.
+ */
+static int
+lowest_bit(unsigned int x)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(x);
+#else
+  int n = 0;
+  for (; !(x & 1); x >>= 1)
+    n++;
+  return n;
+#endif
+}
+
+
+/* Write the positions set in a liberty bitmap into libs[], in
+ * increasing order and at most maxlib of them. libs may be NULL.
+ * The full number of positions in the bitmap is returned.
+ */
+static int
+list_liberty_bits(const unsigned int *bits, int maxlib, int *libs)
+{
+  int liberties = 0;
+  int k;
+
+  for (k = 0; k < LIBERTY_BITMAP_WORDS; k++) {
+    unsigned int word = bits[k];
+    if (word == 0)
+      continue;
+    if (libs) {
+      while (word != 0 && liberties < maxlib) {
+	libs[liberties++] = 32 * k + lowest_bit(word);
+	word &= word - 1;
+      }
+    }
+    liberties += popcount(word);
+  }
+
+  return liberties;
+}
+
+
 /* Find the liberties of the string at str. str must not be
  * empty. The locations of up to maxlib liberties are written into
  * libs[]. The full number of liberties is returned.
@@ -1546,8 +2107,8 @@ findlib(int str, int maxlib, int *libs)
    *
    * However, if the string has more than MAX_LIBERTIES liberties the
    * list is truncated and if maxlib is also larger than MAX_LIBERTIES
-   * we have to traverse the stones in the string in order to find
-   * where the liberties are.
+   * we have to look in the liberty bitmap in order to find where the
+   * liberties are.
    */
   s = string_number[str];
   liberties = string[s].liberties;
@@ -1560,44 +2121,10 @@ findlib(int str, int maxlib, int *libs)
       libs[k] = string_libs[s].list[k];
   }
   else {
-    /* The harder case, where we have to traverse the stones in the
-     * string. We don't have to check explicitly if we are back to
-     * the start of the chain since we will run out of liberties
-     * before that happens.
+    /* The harder case, where the list is truncated. Then we take
+     * the liberties from the bitmap instead.
      */
-    int pos;
-    liberty_mark++;
-    for (k = 0, pos = FIRST_STONE(s);
-	 k < maxlib && k < liberties;
-	 pos = NEXT_STONE(pos)) {
-      if (UNMARKED_LIBERTY(SOUTH(pos))) {
-	libs[k++] = SOUTH(pos);
-	MARK_LIBERTY(SOUTH(pos));
-	if (k >= maxlib)
-	  break;
-      }
-      
-      if (UNMARKED_LIBERTY(WEST(pos))) {
-	libs[k++] = WEST(pos);
-	MARK_LIBERTY(WEST(pos));
-	if (k >= maxlib)
-	  break;
-      }
-      
-      if (UNMARKED_LIBERTY(NORTH(pos))) {
-	libs[k++] = NORTH(pos);
-	MARK_LIBERTY(NORTH(pos));
-	if (k >= maxlib)
-	  break;
-      }
-      
-      if (UNMARKED_LIBERTY(EAST(pos))) {
-	libs[k++] = EAST(pos);
-	MARK_LIBERTY(EAST(pos));
-	if (k >= maxlib)
-	  break;
-      }
-    }
+    list_liberty_bits(string_libs[s].bits, maxlib, libs);
   }
       
   return liberties;
@@ -1779,7 +2306,7 @@ struct board_cache_entry {
 
 
 /* approxlib() cache. */
-static struct board_cache_entry approxlib_cache[BOARDMAX][2];
+static BOARD_TLS struct board_cache_entry approxlib_cache[BOARDMAX][2];
 
 
 /* Clears approxlib() cache. This function should be called only once
@@ -2071,7 +2598,7 @@ slow_approxlib(int pos, int color, int maxlib, int *libs)
 
 
 /* accuratelib() cache. */
-static struct board_cache_entry accuratelib_cache[BOARDMAX][2];
+static BOARD_TLS struct board_cache_entry accuratelib_cache[BOARDMAX][2];
 
 
 /* Clears accuratelib() cache. This function should be called only once
@@ -2334,57 +2861,42 @@ do_accuratelib(int pos, int color, int maxlib, int *libs)
 int
 count_common_libs(int str1, int str2)
 {
-  int all_libs1[MAXLIBS], *libs1;
-  int liberties1, liberties2;
+  int *libs1;
+  int liberties1;
   int commonlibs = 0;
-  int k, n, tmp;
+  int k, n1, n2, tmp;
   
   ASSERT_ON_BOARD1(str1);
   ASSERT_ON_BOARD1(str2);
   ASSERT1(IS_STONE(board[str1]), str1);
   ASSERT1(IS_STONE(board[str2]), str2);
   
-  n = string_number[str1];
-  liberties1 = string[n].liberties;
-  
-  if (liberties1 > string[string_number[str2]].liberties) {
-    n = string_number[str2];
-    liberties1 = string[n].liberties;
-    tmp = str1;
-    str1 = str2;
-    str2 = tmp;
+  n1 = string_number[str1];
+  n2 = string_number[str2];
+  if (string[n1].liberties > string[n2].liberties) {
+    tmp = n1;
+    n1 = n2;
+    n2 = tmp;
   }
+  liberties1 = string[n1].liberties;
 
   if (liberties1 <= MAX_LIBERTIES) {
-    /* Speed optimization: don't copy liberties with findlib */
-    libs1 = string_libs[n].list;
-    n = string_number[str2];
-    liberties2 = string[n].liberties;
-    
-    if (liberties2 <= MAX_LIBERTIES) {
-      /* Speed optimization: NEIGHBOR_OF_STRING is quite expensive */
-      liberty_mark++;
-      
-      for (k = 0; k < liberties1; k++)
-	MARK_LIBERTY(libs1[k]);
-
-      libs1 = string_libs[n].list;
-      for (k = 0; k < liberties2; k++)
-	if (!UNMARKED_LIBERTY(libs1[k]))
-	  commonlibs++;
-
-      return commonlibs;
-    }
+    /* Speed optimization: test the few listed liberties of the first
+     * string in the liberty bitmap of the second.
+     */
+    libs1 = string_libs[n1].list;
+    for (k = 0; k < liberties1; k++)
+      if (IS_LIBERTY_BIT_SET(n2, libs1[k]))
+	commonlibs++;
   }
   else {
-    findlib(str1, MAXLIBS, all_libs1);
-    libs1 = all_libs1;
+    for (k = 0; k < LIBERTY_BITMAP_WORDS; k++) {
+      unsigned int common = string_libs[n1].bits[k] & string_libs[n2].bits[k];
+      if (common)
+	commonlibs += popcount(common);
+    }
   }
   
-  for (k = 0; k < liberties1; k++)
-    if (NEIGHBOR_OF_STRING(libs1[k], string_number[str2], board[str2]))
-      commonlibs++;
-  
   return commonlibs;
 }
 
@@ -2401,10 +2913,11 @@ count_common_libs(int str1, int str2)
 int
 find_common_libs(int str1, int str2, int maxlib, int *libs)
 {
-  int all_libs1[MAXLIBS], *libs1;
+  unsigned int common[LIBERTY_BITMAP_WORDS];
+  int *libs1;
   int liberties1, liberties2;
   int commonlibs = 0;
-  int k, n, tmp;
+  int k, n1, n2, tmp;
   
   ASSERT_ON_BOARD1(str1);
   ASSERT_ON_BOARD1(str2);
@@ -2412,54 +2925,43 @@ find_common_libs(int str1, int str2, int maxlib, int *libs)
   ASSERT1(IS_STONE(board[str2]), str2);
   ASSERT1(libs != NULL, str1);
   
-  n = string_number[str1];
-  liberties1 = string[n].liberties;
-  
-  if (liberties1 > string[string_number[str2]].liberties) {
-    n = string_number[str2];
-    liberties1 = string[n].liberties;
-    tmp = str1;
-    str1 = str2;
-    str2 = tmp;
-  }
+  n1 = string_number[str1];
+  n2 = string_number[str2];
+  if (string[n1].liberties > string[n2].liberties) {
+    tmp = n1;
+    n1 = n2;
+    n2 = tmp;
+  }
+  liberties1 = string[n1].liberties;
+  liberties2 = string[n2].liberties;
   
   if (liberties1 <= MAX_LIBERTIES) {
-    /* Speed optimization: don't copy liberties with findlib */
-    libs1 = string_libs[n].list;
-    n = string_number[str2];
-    liberties2 = string[n].liberties;
-
+    /* Speed optimization: test listed liberties in the liberty bitmap
+     * of the other string. If both lists are complete, we go through
+     * the second one.
+     */
     if (liberties2 <= MAX_LIBERTIES) {
-      /* Speed optimization: NEIGHBOR_OF_STRING is quite expensive */
-      liberty_mark++;
-
-      for (k = 0; k < liberties1; k++)
-	MARK_LIBERTY(libs1[k]);
-      
-      libs1 = string_libs[n].list;
-      for (k = 0; k < liberties2; k++)
-	if (!UNMARKED_LIBERTY(libs1[k])) {
-          if (commonlibs < maxlib)
-	    libs[commonlibs] = libs1[k];
-	  commonlibs++;
-	}
-      
-      return commonlibs;
+      tmp = n1;
+      n1 = n2;
+      n2 = tmp;
+      liberties1 = liberties2;
     }
+
+    libs1 = string_libs[n1].list;
+    for (k = 0; k < liberties1; k++)
+      if (IS_LIBERTY_BIT_SET(n2, libs1[k])) {
+	if (commonlibs < maxlib)
+	  libs[commonlibs] = libs1[k];
+	commonlibs++;
+      }
+    
+    return commonlibs;
   }
-  else {
-    findlib(str1, MAXLIBS, all_libs1);
-    libs1 = all_libs1;
-  }
-  
-  for (k = 0; k < liberties1; k++)
-    if (NEIGHBOR_OF_STRING(libs1[k], string_number[str2], board[str2])) {
-      if (commonlibs < maxlib)
-	libs[commonlibs] = libs1[k];
-      commonlibs++;
-    }
+
+  for (k = 0; k < LIBERTY_BITMAP_WORDS; k++)
+    common[k] = string_libs[n1].bits[k] & string_libs[n2].bits[k];
   
-  return commonlibs;
+  return list_liberty_bits(common, maxlib, libs);
 }
 
 
@@ -2469,38 +2971,42 @@ find_common_libs(int str1, int str2, int maxlib, int *libs)
 int
 have_common_lib(int str1, int str2, int *lib)
 {
-  int all_libs1[MAXLIBS], *libs1;
+  int *libs1;
   int liberties1;
-  int k, n, tmp;
+  int k, n1, n2, tmp;
   
   ASSERT_ON_BOARD1(str1);
   ASSERT_ON_BOARD1(str2);
   ASSERT1(IS_STONE(board[str1]), str1);
   ASSERT1(IS_STONE(board[str2]), str2);
   
-  n = string_number[str1];
-  liberties1 = string[n].liberties;
+  n1 = string_number[str1];
+  n2 = string_number[str2];
+  if (string[n1].liberties > string[n2].liberties) {
+    tmp = n1;
+    n1 = n2;
+    n2 = tmp;
+  }
+  liberties1 = string[n1].liberties;
   
-  if (liberties1 > string[string_number[str2]].liberties) {
-    n = string_number[str2];
-    liberties1 = string[n].liberties;
-    tmp = str1;
-    str1 = str2;
-    str2 = tmp;
-  }
-  
-  if (liberties1 <= MAX_LIBERTIES)
-    /* Speed optimization: don't copy liberties with findlib */
-    libs1 = string_libs[n].list;
-  else {
-    findlib(str1, MAXLIBS, all_libs1);
-    libs1 = all_libs1;
+  if (liberties1 <= MAX_LIBERTIES) {
+    /* Speed optimization: test the listed liberties in the bitmap. */
+    libs1 = string_libs[n1].list;
+    for (k = 0; k < liberties1; k++) {
+      if (IS_LIBERTY_BIT_SET(n2, libs1[k])) {
+	if (lib)
+	  *lib = libs1[k];
+	return 1;
+      }
+    }
+    return 0;
   }
 
-  for (k = 0; k < liberties1; k++) {
-    if (NEIGHBOR_OF_STRING(libs1[k], string_number[str2], board[str2])) {
+  for (k = 0; k < LIBERTY_BITMAP_WORDS; k++) {
+    unsigned int common = string_libs[n1].bits[k] & string_libs[n2].bits[k];
+    if (common) {
       if (lib)
-	*lib = libs1[k];
+	*lib = 32 * k + lowest_bit(common);
       return 1;
     }
   }
@@ -3119,18 +3625,19 @@ is_ko_point(int pos)
  * according to the specified type of ko rules. This function does not
  * detect simple ko unless it's also a superko violation.
  *
- * The superko detection is done by comparing board hashes from
- * previous positions. For this to work correctly it's necessary to
- * remove the contribution to the hash from the simple ko position.
- * The move_history_hash array contains board hashes for previous
- * positions, also without simple ko position contributions.
+ * The superko detection is done by looking up the board hash of the
+ * new position in the set of previous positions. For this to work
+ * correctly it's necessary to remove the contribution to the hash
+ * from the simple ko position. The position set contains board
+ * hashes for previous positions, also without simple ko position
+ * contributions.
  */
 static int
 is_superko_violation(int pos, int color, enum ko_rules type)
 {
   Hash_data this_board_hash = board_hash;
   Hash_data new_board_hash;
-  int k;
+  struct position_entry *entry;
 
   /* No superko violations if the ko rule is not a superko rule. */
   if (type == NONE || type == SIMPLE)
@@ -3151,13 +3658,20 @@ is_superko_violation(int pos, int color, enum ko_rules type)
   if (type == PSK && hashdata_is_equal(this_board_hash, new_board_hash))
     return 1;
 
-  for (k = move_history_pointer - 1; k >= 0; k--)
-    if (hashdata_is_equal(move_history_hash[k], new_board_hash)
-	&& (type == PSK
-	    || move_history_color[k] == OTHER_COLOR(color)))
-      return 1;
+  if (position_set == NULL)
+    return 0;
 
-  return 0;
+  entry = find_position(&new_board_hash);
+  if (!entry->used)
+    return 0;
+
+  /* With situational superko the position is only repeated if the
+   * opponent was to move then too.
+   */
+  if (type == PSK)
+    return entry->count[0] + entry->count[1] > 0;
+  else
+    return entry->count[OTHER_COLOR(color) - 1] > 0;
 }
 
 /* Returns 1 if at least one string is captured when color plays at pos.
@@ -3235,9 +3749,9 @@ get_move_from_stack(int k, int *move, int *color)
 int
 stones_on_board(int color)
 {
-  static int stone_count_for_position = -1;
-  static int white_stones = 0;
-  static int black_stones = 0;
+  static BOARD_TLS int stone_count_for_position = -1;
+  static BOARD_TLS int white_stones = 0;
+  static BOARD_TLS int black_stones = 0;
 
   gg_assert(stackp == 0);
 
@@ -3279,6 +3793,58 @@ get_trymove_counter()
 }
 
 
+/* Name of the way popgo() undoes moves in this build. */
+const char *
+undo_strategy_name(void)
+{
+#if SNAPSHOT_UNDO
+  return "snapshot";
+#else
+  return "change stack";
+#endif
+}
+
+
+/* Micro-benchmark of trymove() and popgo(). Try each move for color
+ * on the current board and, under each legal one, each reply, all
+ * num_iterations times. Return the time spent and the number of
+ * successful trymove() and popgo() pairs in *num_pairs.
+ */
+double
+trymove_benchmark(int color, int num_iterations, int *num_pairs)
+{
+  int moves[BOARDMAX];
+  int num_moves = 0;
+  int pos;
+  int k, m, n;
+  int pairs = 0;
+  double t;
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    if (board[pos] == EMPTY)
+      moves[num_moves++] = pos;
+
+  t = gg_gettimeofday();
+  for (k = 0; k < num_iterations; k++)
+    for (m = 0; m < num_moves; m++) {
+      if (!trymove(moves[m], color, "trymove_benchmark", NO_MOVE))
+	continue;
+      pairs++;
+      for (n = 0; n < num_moves; n++)
+	if (trymove(moves[n], OTHER_COLOR(color), "trymove_benchmark",
+		    NO_MOVE)) {
+	  pairs++;
+	  popgo();
+	}
+      popgo();
+    }
+  t = gg_gettimeofday() - t;
+
+  *num_pairs = pairs;
+  return t;
+}
+
+
 /* ================================================================ */
 /*                      Lower level functions                       */
 /* ================================================================ */
@@ -3491,21 +4057,25 @@ find_liberties_and_neighbors(int s)
 
 
 /* Update the liberties of a string from scratch, first pushing the
- * old information.
+ * old information. Only the words of the liberty bitmap which change
+ * are pushed, after the update.
  */
 
 static void
 update_liberties(int s)
 {
+  unsigned int old_bits[LIBERTY_BITMAP_WORDS];
   int pos;
   int k;
 
   /* Push the old information. */
-  PUSH_VALUE(string[s].liberties);
+  PUSH_STRING_VALUE(s, string[s].liberties);
   for (k = 0; k < string[s].liberties && k < MAX_LIBERTIES; k++) {
-    PUSH_VALUE(string_libs[s].list[k]);
+    PUSH_STRING_VALUE(s, string_libs[s].list[k]);
   }
+  memcpy(old_bits, string_libs[s].bits, sizeof(old_bits));
   string[s].liberties = 0;
+  CLEAR_LIBERTY_BITS(s);
 
   /* Clear the liberty mark. */
   liberty_mark++;
@@ -3534,6 +4104,10 @@ update_liberties(int s)
     
     pos = NEXT_STONE(pos);
   } while (!BACK_TO_FIRST_STONE(s, pos));
+
+  for (k = 0; k < LIBERTY_BITMAP_WORDS; k++)
+    if (string_libs[s].bits[k] != old_bits[k])
+      PUSH_OLD_LIBERTY_WORD(s, k, old_bits[k]);
 }
 
 
@@ -3553,9 +4127,9 @@ remove_neighbor(int str_number, int n)
       /* We need to push the last entry too because it may become
        * destroyed later.
        */
-      PUSH_VALUE(sn->list[s->neighbors - 1]);
-      PUSH_VALUE(sn->list[k]);
-      PUSH_VALUE(s->neighbors);
+      PUSH_STRING_VALUE(str_number, sn->list[s->neighbors - 1]);
+      PUSH_STRING_VALUE(str_number, sn->list[k]);
+      PUSH_STRING_VALUE(str_number, s->neighbors);
       sn->list[k] = sn->list[s->neighbors - 1];
       s->neighbors--;
       done = 1;
@@ -3565,9 +4139,35 @@ remove_neighbor(int str_number, int n)
 }
 
 
+/* Find a liberty of string s in its liberty bitmap which is not in
+ * its liberty list. There must be one.
+ */
+
+static int
+unlisted_liberty(int s)
+{
+  int k;
+  int l;
+
+  for (k = 0; k < LIBERTY_BITMAP_WORDS; k++) {
+    unsigned int word = string_libs[s].bits[k];
+    for (l = 0; l < MAX_LIBERTIES && word != 0; l++)
+      if (string_libs[s].list[l] / 32 == k)
+	word &= ~LIBERTY_BIT(string_libs[s].list[l]);
+    if (word != 0)
+      return 32 * k + lowest_bit(word);
+  }
+
+  gg_assert(0);
+  return NO_MOVE;
+}
+
+
 /* Remove one liberty from the list of liberties, pushing changed
  * information. If the string had more liberties than the size of the
- * list, rebuild the list from scratch.
+ * list, the bitmap still has them all, so we only clear the bit and,
+ * if pos is in the truncated list, replace it with another liberty
+ * from the bitmap.
  */
 
 static void
@@ -3577,19 +4177,31 @@ remove_liberty(int str_number, int pos)
   struct string_data *s = &string[str_number];
   struct string_liberties_data *sl = &string_libs[str_number];
   
-  if (s->liberties > MAX_LIBERTIES)
-    update_liberties(str_number);
+  if (s->liberties > MAX_LIBERTIES) {
+    PUSH_STRING_VALUE(str_number, s->liberties);
+    PUSH_LIBERTY_WORD(str_number, pos);
+    s->liberties--;
+    CLEAR_LIBERTY_BIT(str_number, pos);
+    for (k = 0; k < MAX_LIBERTIES; k++)
+      if (sl->list[k] == pos) {
+	PUSH_STRING_VALUE(str_number, sl->list[k]);
+	sl->list[k] = unlisted_liberty(str_number);
+	break;
+      }
+  }
   else {
     for (k = 0; k < s->liberties; k++)
       if (sl->list[k] == pos) {
 	/* We need to push the last entry too because it may become
 	 * destroyed later.
 	 */
-	PUSH_VALUE(sl->list[s->liberties - 1]);
-	PUSH_VALUE(sl->list[k]);
-	PUSH_VALUE(s->liberties);
+	PUSH_STRING_VALUE(str_number, sl->list[s->liberties - 1]);
+	PUSH_STRING_VALUE(str_number, sl->list[k]);
+	PUSH_STRING_VALUE(str_number, s->liberties);
+	PUSH_LIBERTY_WORD(str_number, pos);
 	sl->list[k] = sl->list[s->liberties - 1];
 	s->liberties--;
+	CLEAR_LIBERTY_BIT(str_number, pos);
 	break;
       }
   }
@@ -3627,11 +4239,9 @@ do_remove_string(int s)
       int neighbor = string_neighbors[s].list[k];
 
       remove_neighbor(neighbor, s);
-      PUSH_VALUE(string[neighbor].liberties);
-
-      if (string[neighbor].liberties < MAX_LIBERTIES)
-	string_libs[neighbor].list[string[neighbor].liberties] = pos;
-      string[neighbor].liberties++;
+      PUSH_STRING_VALUE(neighbor, string[neighbor].liberties);
+      PUSH_LIBERTY_WORD(neighbor, pos);
+      ADD_LIBERTY(neighbor, pos);
     }
   }
   else if (size == 2) {
@@ -3642,18 +4252,16 @@ do_remove_string(int s)
       int neighbor = string_neighbors[s].list[k];      
 
       remove_neighbor(neighbor, s);
-      PUSH_VALUE(string[neighbor].liberties);
+      PUSH_STRING_VALUE(neighbor, string[neighbor].liberties);
 
       if (NEIGHBOR_OF_STRING(pos, neighbor, other)) {
-	if (string[neighbor].liberties < MAX_LIBERTIES)
-	  string_libs[neighbor].list[string[neighbor].liberties] = pos;
-	string[neighbor].liberties++;
+	PUSH_LIBERTY_WORD(neighbor, pos);
+	ADD_LIBERTY(neighbor, pos);
       }
 
       if (NEIGHBOR_OF_STRING(pos2, neighbor, other)) {
-	if (string[neighbor].liberties < MAX_LIBERTIES)
-	  string_libs[neighbor].list[string[neighbor].liberties] = pos2;
-	string[neighbor].liberties++;
+	PUSH_LIBERTY_WORD(neighbor, pos2);
+	ADD_LIBERTY(neighbor, pos2);
       }
     }
   }
@@ -3701,6 +4309,7 @@ create_new_string(int pos)
   string[s].liberties = 0;
   string[s].neighbors = 0;
   string[s].mark = 0;
+  CLEAR_LIBERTY_BITS(s);
 
   /* Clear the string mark. */
   string_mark++;
@@ -3716,7 +4325,7 @@ create_new_string(int pos)
     /* Add the neighbor to our list. */
     ADD_NEIGHBOR(s, SOUTH(pos));
     /* Add us to our neighbor's list. */
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     MARK_STRING(SOUTH(pos));
   }
@@ -3729,7 +4338,7 @@ create_new_string(int pos)
     /* Add the neighbor to our list. */
     ADD_NEIGHBOR(s, WEST(pos));
     /* Add us to our neighbor's list. */
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     MARK_STRING(WEST(pos));
   }
@@ -3742,7 +4351,7 @@ create_new_string(int pos)
     /* Add the neighbor to our list. */
     ADD_NEIGHBOR(s, NORTH(pos));
     /* Add us to our neighbor's list. */
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     MARK_STRING(NORTH(pos));
   }
@@ -3755,7 +4364,7 @@ create_new_string(int pos)
     /* Add the neighbor to our list. */
     ADD_NEIGHBOR(s, EAST(pos));
     /* Add us to our neighbor's list. */
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     /* No need to mark since no visits left. */
 #if 0
@@ -3784,14 +4393,14 @@ extend_neighbor_string(int pos, int s)
   
   /* Do we need to update the origin? */
   if (pos < pos2) {
-    PUSH_VALUE(string[s].origin);
+    PUSH_STRING_VALUE(s, string[s].origin);
     string[s].origin = pos;
   }
   
   string_number[pos] = s;
 
   /* The size of the string has increased by one. */
-  PUSH_VALUE(string[s].size);
+  PUSH_STRING_VALUE(s, string[s].size);
   string[s].size++;
 
   /* If s has too many liberties, we don't know where they all are and
@@ -3822,56 +4431,64 @@ extend_neighbor_string(int pos, int s)
    */
   if (LIBERTY(SOUTH(pos))) {
     if (!liberties_updated
-	&& !NON_SOUTH_NEIGHBOR_OF_STRING(SOUTH(pos), s, color))
+	&& !NON_SOUTH_NEIGHBOR_OF_STRING(SOUTH(pos), s, color)) {
+      PUSH_LIBERTY_WORD(s, SOUTH(pos));
       ADD_LIBERTY(s, SOUTH(pos));
+    }
   }
   else if (UNMARKED_COLOR_STRING(SOUTH(pos), other)) {
     int s2 = string_number[SOUTH(pos)];
-    PUSH_VALUE(string[s].neighbors);
+    PUSH_STRING_VALUE(s, string[s].neighbors);
     ADD_NEIGHBOR(s, SOUTH(pos));
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     MARK_STRING(SOUTH(pos));
   }
   
   if (LIBERTY(WEST(pos))) {
     if (!liberties_updated
-	&& !NON_WEST_NEIGHBOR_OF_STRING(WEST(pos), s, color))
+	&& !NON_WEST_NEIGHBOR_OF_STRING(WEST(pos), s, color)) {
+      PUSH_LIBERTY_WORD(s, WEST(pos));
       ADD_LIBERTY(s, WEST(pos));
+    }
   }
   else if (UNMARKED_COLOR_STRING(WEST(pos), other)) {
     int s2 = string_number[WEST(pos)];
-    PUSH_VALUE(string[s].neighbors);
+    PUSH_STRING_VALUE(s, string[s].neighbors);
     ADD_NEIGHBOR(s, WEST(pos));
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     MARK_STRING(WEST(pos));
   }
   
   if (LIBERTY(NORTH(pos))) {
     if (!liberties_updated
-	&& !NON_NORTH_NEIGHBOR_OF_STRING(NORTH(pos), s, color))
+	&& !NON_NORTH_NEIGHBOR_OF_STRING(NORTH(pos), s, color)) {
+      PUSH_LIBERTY_WORD(s, NORTH(pos));
       ADD_LIBERTY(s, NORTH(pos));
+    }
   }
   else if (UNMARKED_COLOR_STRING(NORTH(pos), other)) {
     int s2 = string_number[NORTH(pos)];
-    PUSH_VALUE(string[s].neighbors);
+    PUSH_STRING_VALUE(s, string[s].neighbors);
     ADD_NEIGHBOR(s, NORTH(pos));
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
     MARK_STRING(NORTH(pos));
   }
   
   if (LIBERTY(EAST(pos))) {
     if (!liberties_updated
-	&& !NON_EAST_NEIGHBOR_OF_STRING(EAST(pos), s, color))
+	&& !NON_EAST_NEIGHBOR_OF_STRING(EAST(pos), s, color)) {
+      PUSH_LIBERTY_WORD(s, EAST(pos));
       ADD_LIBERTY(s, EAST(pos));
+    }
   }
   else if (UNMARKED_COLOR_STRING(EAST(pos), other)) {
     int s2 = string_number[EAST(pos)];
-    PUSH_VALUE(string[s].neighbors);
+    PUSH_STRING_VALUE(s, string[s].neighbors);
     ADD_NEIGHBOR(s, EAST(pos));
-    PUSH_VALUE(string[s2].neighbors);
+    PUSH_STRING_VALUE(s2, string[s2].neighbors);
     ADD_NEIGHBOR(s2, pos);
 #if 0
     MARK_STRING(EAST(pos));
@@ -3952,7 +4569,7 @@ assimilate_string(int s, int pos)
     int t = string_neighbors[s2].list[k];
     remove_neighbor(t, s2);
     if (string[t].mark != string_mark) {
-      PUSH_VALUE(string[t].neighbors);
+      PUSH_STRING_VALUE(t, string[t].neighbors);
       string_neighbors[t].list[string[t].neighbors++] = s;
       string_neighbors[s].list[string[s].neighbors++] = t;
       string[t].mark = string_mark;
@@ -3986,6 +4603,7 @@ assimilate_neighbor_strings(int pos)
   string[s].origin = pos;
   string[s].liberties = 0;
   string[s].neighbors = 0;
+  CLEAR_LIBERTY_BITS(s);
 
   /* Clear the marks. */
   liberty_mark++;
@@ -4006,7 +4624,8 @@ assimilate_neighbor_strings(int pos)
   }
   else if (UNMARKED_COLOR_STRING(SOUTH(pos), other)) {
     ADD_NEIGHBOR(s, SOUTH(pos));
-    PUSH_VALUE(string[string_number[SOUTH(pos)]].neighbors);
+    PUSH_STRING_VALUE(string_number[SOUTH(pos)],
+		      string[string_number[SOUTH(pos)]].neighbors);
     ADD_NEIGHBOR(string_number[SOUTH(pos)], pos);
     MARK_STRING(SOUTH(pos));
   }
@@ -4019,7 +4638,8 @@ assimilate_neighbor_strings(int pos)
   }
   else if (UNMARKED_COLOR_STRING(WEST(pos), other)) {
     ADD_NEIGHBOR(s, WEST(pos));
-    PUSH_VALUE(string[string_number[WEST(pos)]].neighbors);
+    PUSH_STRING_VALUE(string_number[WEST(pos)],
+		      string[string_number[WEST(pos)]].neighbors);
     ADD_NEIGHBOR(string_number[WEST(pos)], pos);
     MARK_STRING(WEST(pos));
   }
@@ -4032,7 +4652,8 @@ assimilate_neighbor_strings(int pos)
   }
   else if (UNMARKED_COLOR_STRING(NORTH(pos), other)) {
     ADD_NEIGHBOR(s, NORTH(pos));
-    PUSH_VALUE(string[string_number[NORTH(pos)]].neighbors);
+    PUSH_STRING_VALUE(string_number[NORTH(pos)],
+		      string[string_number[NORTH(pos)]].neighbors);
     ADD_NEIGHBOR(string_number[NORTH(pos)], pos);
     MARK_STRING(NORTH(pos));
   }
@@ -4049,7 +4670,8 @@ assimilate_neighbor_strings(int pos)
   }
   else if (UNMARKED_COLOR_STRING(EAST(pos), other)) {
     ADD_NEIGHBOR(s, EAST(pos));
-    PUSH_VALUE(string[string_number[EAST(pos)]].neighbors);
+    PUSH_STRING_VALUE(string_number[EAST(pos)],
+		      string[string_number[EAST(pos)]].neighbors);
     ADD_NEIGHBOR(string_number[EAST(pos)], pos);
 #if 0
     MARK_STRING(EAST(pos));
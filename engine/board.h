@@ -29,6 +29,17 @@
 #include "sgftree.h"
 #include "winsocket.h"
 
+/* The board state is thread local when the compiler supports it, so
+ * that every thread reads and plays moves on a board of its own. A
+ * position is handed to another thread with store_board() and
+ * restore_board().
+ */
+#if defined(HAVE_PTHREAD_H) && defined(__GNUC__)
+#define BOARD_TLS __thread
+#else
+#define BOARD_TLS
+#endif
+
 /* This type is used to store each intersection on the board.
  *
  * On a 486, char is best, since the time taken to push and pop
@@ -101,9 +112,14 @@ typedef unsigned char Intersection;
 
 /* Board sizes */
 
-
+/* MAX_BOARD can be overridden at compile time, e.g. with
+ * CFLAGS=-DMAX_BOARD=9, for a smaller and faster build which only
+ * plays on small boards.
+ */
 #define MIN_BOARD          1       /* Minimum supported board size.   */
+#ifndef MAX_BOARD
 #define MAX_BOARD         19       /* Maximum supported board size.   */
+#endif
 #define MAX_HANDICAP       9       /* Maximum supported handicap.     */
 #define MAX_MOVE_HISTORY 500       /* Max number of moves remembered. */
 
@@ -183,27 +199,31 @@ const char *color_to_string(int color);
 /*                         global variables                         */
 /* ================================================================ */
 
-/* The board and the other parameters deciding the current position. */
-extern int          board_size;             /* board size (usually 19) */
-extern Intersection board[BOARDSIZE];       /* go board */
-extern int          board_ko_pos;
-extern int          black_captured;   /* num. of black stones captured */
-extern int          white_captured;
-
-extern Intersection initial_board[BOARDSIZE];
-extern int          initial_board_ko_pos;
-extern int          initial_white_captured;
-extern int          initial_black_captured;
-extern int          move_history_color[MAX_MOVE_HISTORY];
-extern int          move_history_pos[MAX_MOVE_HISTORY];
-extern Hash_data    move_history_hash[MAX_MOVE_HISTORY];
-extern int          move_history_pointer;
-
-extern float        komi;
-extern int          handicap;     /* used internally in chinese scoring */
-extern int          movenum;      /* movenumber - used for debug output */
+/* The board and the other parameters deciding the current position.
+ * Each thread has its own copy of these, see BOARD_TLS.
+ */
+extern BOARD_TLS int          board_size;  /* board size (usually 19) */
+extern BOARD_TLS Intersection board[BOARDSIZE];       /* go board */
+extern BOARD_TLS int          board_ko_pos;
+extern BOARD_TLS int          black_captured; /* num. of black stones captured */
+extern BOARD_TLS int          white_captured;
+
+extern BOARD_TLS Intersection initial_board[BOARDSIZE];
+extern BOARD_TLS int          initial_board_ko_pos;
+extern BOARD_TLS int          initial_white_captured;
+extern BOARD_TLS int          initial_black_captured;
+extern BOARD_TLS int          move_history_color[MAX_MOVE_HISTORY];
+extern BOARD_TLS int          move_history_pos[MAX_MOVE_HISTORY];
+extern BOARD_TLS Hash_data    move_history_hash[MAX_MOVE_HISTORY];
+extern BOARD_TLS int          move_history_pointer;
+
+extern BOARD_TLS float        komi;
+extern BOARD_TLS int          handicap; /* used internally in chinese scoring */
+extern BOARD_TLS int          movenum;  /* movenumber - used for debug output */
 		    
-extern signed char  shadow[BOARDMAX];      /* reading tree shadow */
+extern BOARD_TLS signed char  shadow[BOARDMAX];  /* reading tree shadow */
+
+extern BOARD_TLS Hash_data    board_hash; /* hash of the current position */
 
 enum suicide_rules {
   FORBIDDEN,
@@ -221,11 +241,14 @@ enum ko_rules {
 extern enum ko_rules ko_rule;
 
 
-extern int stackp;                /* stack pointer */
+extern BOARD_TLS int stackp;      /* stack pointer */
 extern int count_variations;      /* count (decidestring) */
 extern SGFTree *sgf_dumptree;
 
 
+/* Positions collapsed out of the move history, see board.c. */
+struct older_positions;
+
 /* This struct holds the internal board state. */
 struct board_state {
   int board_size;
@@ -243,6 +266,7 @@ struct board_state {
   int move_history_pos[MAX_MOVE_HISTORY];
   Hash_data move_history_hash[MAX_MOVE_HISTORY];
   int move_history_pointer;
+  struct older_positions *older_positions;
 
   float komi;
   int handicap;
@@ -252,7 +276,7 @@ struct board_state {
 /* This is increased by one anytime a move is (permanently) played or
  * the board is cleared.
  */
-extern int position_number;
+extern BOARD_TLS int position_number;
 
 /* ================================================================ */
 /*                        board.c functions                         */
@@ -271,6 +295,7 @@ int undo_move(int n);
 
 void store_board(struct board_state *state);
 void restore_board(struct board_state *state);
+void free_board_state(void);
 
 /* Information about the permanent board. */
 int get_last_move(void);
@@ -295,6 +320,8 @@ void do_dump_stack(void);
 
 void reset_trymove_counter(void);
 int get_trymove_counter(void);
+const char *undo_strategy_name(void);
+double trymove_benchmark(int color, int num_iterations, int *num_pairs);
 
 /* move properties */
 int is_pass(int pos);
@@ -412,7 +439,7 @@ struct stats_data {
                                  /* with sufficient remaining depth. */
 };
 
-extern struct stats_data stats;
+extern BOARD_TLS struct stats_data stats;
 
 
 /* printutils.c */
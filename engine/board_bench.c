@@ -0,0 +1,305 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Micro-benchmark of the primitives in board.c.
+ *
+ * Usage: board_bench [-i interval] [-n calls] sgffile ...
+ *
+ * Replays the main line of each game and, every interval moves (20
+ * by default), times each primitive on the position. Point
+ * primitives are called for each empty point, string primitives for
+ * each string and trymove() for each legal move, all for the color to
+ * move and repeated to at least the given number of calls (10000 by
+ * default). The liberty functions are given a liberty array, so that
+ * they bypass the caches. For each primitive the mean time per call
+ * over the positions is printed with its standard deviation.
+ *
+ * The board_bench_run target runs it on the .sgf files under
+ * regression/games.
+ */
+
+#include "board.h"
+#include "sgftree.h"
+#include "gg_utils.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum primitive {
+  TRYMOVE,
+  APPROXLIB,
+  ACCURATELIB,
+  FASTLIB,
+  CHAINLINKS,
+  FINDLIB,
+  IS_SELF_ATARI,
+  DOES_CAPTURE_SOMETHING,
+  NUM_PRIMITIVES
+};
+
+static const char *primitive_names[NUM_PRIMITIVES] = {
+  "trymove/popgo",
+  "approxlib",
+  "accuratelib",
+  "fastlib",
+  "chainlinks",
+  "findlib",
+  "is_self_atari",
+  "does_capture_something"
+};
+
+/* Sum and sum of squares of the ns per call, over the positions. */
+struct timing {
+  int samples;
+  double sum;
+  double sum2;
+};
+
+static struct timing timings[NUM_PRIMITIVES];
+static int num_games = 0;
+static int num_positions = 0;
+
+/* Results are accumulated here so the calls can't be optimized away. */
+static volatile int sink = 0;
+
+
+/* Call primitive k once for each of the num_points points. */
+static void
+run_primitive(int k, int color, int *points, int num_points)
+{
+  int libs[MAXLIBS];
+  int adj[MAXCHAIN];
+  int n;
+
+  for (n = 0; n < num_points; n++) {
+    int pos = points[n];
+    switch (k) {
+    case TRYMOVE:
+      if (trymove(pos, color, "board_bench", NO_MOVE)) {
+	sink++;
+	popgo();
+      }
+      break;
+    case APPROXLIB:
+      sink += approxlib(pos, color, MAXLIBS, libs);
+      break;
+    case ACCURATELIB:
+      sink += accuratelib(pos, color, MAXLIBS, libs);
+      break;
+    case FASTLIB:
+      sink += fastlib(pos, color, 0);
+      break;
+    case CHAINLINKS:
+      sink += chainlinks(pos, adj);
+      break;
+    case FINDLIB:
+      sink += findlib(pos, MAXLIBS, libs);
+      break;
+    case IS_SELF_ATARI:
+      sink += is_self_atari(pos, color);
+      break;
+    case DOES_CAPTURE_SOMETHING:
+      sink += does_capture_something(pos, color);
+      break;
+    }
+  }
+}
+
+
+/* Time all primitives on the current board. */
+static void
+benchmark_position(int color, int min_calls)
+{
+  int empty_points[BOARDMAX];
+  int legal_moves[BOARDMAX];
+  int strings[BOARDMAX];
+  int num_empty = 0;
+  int num_legal = 0;
+  int num_strings = 0;
+  int pos;
+  int k;
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    if (board[pos] == EMPTY) {
+      empty_points[num_empty++] = pos;
+      if (is_legal(pos, color))
+	legal_moves[num_legal++] = pos;
+    }
+    else if (IS_STONE(board[pos]) && find_origin(pos) == pos)
+      strings[num_strings++] = pos;
+  }
+
+  for (k = 0; k < NUM_PRIMITIVES; k++) {
+    int *points;
+    int num_points;
+    int repetitions;
+    int r;
+    double t;
+    double ns;
+
+    if (k == TRYMOVE) {
+      points = legal_moves;
+      num_points = num_legal;
+    }
+    else if (k == CHAINLINKS || k == FINDLIB) {
+      points = strings;
+      num_points = num_strings;
+    }
+    else {
+      points = empty_points;
+      num_points = num_empty;
+    }
+
+    if (num_points == 0)
+      continue;
+
+    repetitions = (min_calls + num_points - 1) / num_points;
+
+    /* Warm up the memory caches before timing. */
+    run_primitive(k, color, points, num_points);
+
+    t = gg_gettimeofday();
+    for (r = 0; r < repetitions; r++)
+      run_primitive(k, color, points, num_points);
+    t = gg_gettimeofday() - t;
+
+    ns = 1e9 * t / (repetitions * num_points);
+    timings[k].samples++;
+    timings[k].sum += ns;
+    timings[k].sum2 += ns * ns;
+  }
+
+  num_positions++;
+}
+
+
+/* Replay the main line of a game, benchmarking every interval moves.
+ * The replay stops at an illegal move. Games on boards larger than
+ * MAX_BOARD are skipped.
+ */
+static void
+benchmark_game(const char *filename, int interval, int min_calls)
+{
+  SGFNode *root = readsgffile(filename);
+  SGFNode *node;
+  int size = 19;
+  int color = BLACK;
+  int moves = 0;
+
+  if (!root) {
+    fprintf(stderr, "board_bench: couldn't read %s\n", filename);
+    return;
+  }
+
+  sgfGetIntProperty(root, "SZ", &size);
+  if (size < MIN_BOARD || size > MAX_BOARD) {
+    sgfFreeNode(root);
+    return;
+  }
+
+  board_size = size;
+  clear_board();
+  num_games++;
+
+  for (node = root; node; node = node->child) {
+    SGFProperty *prop;
+
+    for (prop = node->props; prop; prop = prop->next) {
+      int i, j;
+      int pos = PASS_MOVE;
+
+      if (prop->name != SGFAB && prop->name != SGFAW
+	  && prop->name != SGFB && prop->name != SGFW)
+	continue;
+
+      if (get_moveXY(prop, &i, &j, board_size))
+	pos = POS(i, j);
+
+      if (prop->name == SGFAB || prop->name == SGFAW) {
+	if (pos != PASS_MOVE && board[pos] == EMPTY)
+	  add_stone(pos, prop->name == SGFAB ? BLACK : WHITE);
+	continue;
+      }
+
+      color = (prop->name == SGFB ? BLACK : WHITE);
+      if (!is_legal(pos, color)) {
+	sgfFreeNode(root);
+	return;
+      }
+      play_move(pos, color);
+      color = OTHER_COLOR(color);
+
+      if (++moves % interval == 0)
+	benchmark_position(color, min_calls);
+    }
+  }
+
+  sgfFreeNode(root);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  int interval = 20;
+  int min_calls = 10000;
+  int k;
+
+  for (k = 1; k < argc - 1 && argv[k][0] == '-'; k += 2) {
+    if (strcmp(argv[k], "-i") == 0)
+      interval = atoi(argv[k + 1]);
+    else if (strcmp(argv[k], "-n") == 0)
+      min_calls = atoi(argv[k + 1]);
+    else
+      break;
+  }
+
+  if (k >= argc || interval <= 0 || min_calls <= 0) {
+    fprintf(stderr,
+	    "Usage: board_bench [-i interval] [-n calls] sgffile ...\n");
+    return EXIT_FAILURE;
+  }
+
+  for (; k < argc; k++)
+    benchmark_game(argv[k], interval, min_calls);
+
+  printf("%d games, %d positions, undo by %s\n\n",
+	 num_games, num_positions, undo_strategy_name());
+  printf("%-24s %10s %10s %8s\n", "primitive", "ns/call", "stddev",
+	 "samples");
+  for (k = 0; k < NUM_PRIMITIVES; k++) {
+    double mean = 0.0;
+    double variance = 0.0;
+
+    if (timings[k].samples > 0) {
+      mean = timings[k].sum / timings[k].samples;
+      variance = timings[k].sum2 / timings[k].samples - mean * mean;
+    }
+    printf("%-24s %10.1f %10.1f %8d\n", primitive_names[k], mean,
+	   sqrt(gg_max(variance, 0.0)), timings[k].samples);
+  }
+
+  return EXIT_SUCCESS;
+}
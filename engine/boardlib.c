@@ -27,39 +27,39 @@
 #include "board.h"
 #include "hash.h"
 
-/* The board state itself. */
-int          board_size = DEFAULT_BOARD_SIZE; /* board size */
-Intersection board[BOARDSIZE];
-int          board_ko_pos;
-int          white_captured;    /* number of black and white stones captured */
-int          black_captured;
+/* The board state itself. It is thread local, see BOARD_TLS. */
+BOARD_TLS int          board_size = DEFAULT_BOARD_SIZE; /* board size */
+BOARD_TLS Intersection board[BOARDSIZE];
+BOARD_TLS int          board_ko_pos;
+BOARD_TLS int          white_captured; /* number of black and white stones captured */
+BOARD_TLS int          black_captured;
 
-Intersection initial_board[BOARDSIZE];
-int          initial_board_ko_pos;
-int          initial_white_captured;
-int          initial_black_captured;
-int          move_history_color[MAX_MOVE_HISTORY];
-int          move_history_pos[MAX_MOVE_HISTORY];
-Hash_data    move_history_hash[MAX_MOVE_HISTORY];
-int          move_history_pointer;
+BOARD_TLS Intersection initial_board[BOARDSIZE];
+BOARD_TLS int          initial_board_ko_pos;
+BOARD_TLS int          initial_white_captured;
+BOARD_TLS int          initial_black_captured;
+BOARD_TLS int          move_history_color[MAX_MOVE_HISTORY];
+BOARD_TLS int          move_history_pos[MAX_MOVE_HISTORY];
+BOARD_TLS Hash_data    move_history_hash[MAX_MOVE_HISTORY];
+BOARD_TLS int          move_history_pointer;
 
-float komi = 0.0;
-int handicap = 0;
-int movenum;
+BOARD_TLS float komi = 0.0;
+BOARD_TLS int handicap = 0;
+BOARD_TLS int movenum;
 enum suicide_rules suicide_rule = FORBIDDEN;
 enum ko_rules ko_rule = SIMPLE;
 
 
-signed char shadow[BOARDMAX];
+BOARD_TLS signed char shadow[BOARDMAX];
 
 /* Hashing of positions. */
-Hash_data board_hash;
+BOARD_TLS Hash_data board_hash;
 
-int stackp;             /* stack pointer */
-int position_number;    /* position number */
+BOARD_TLS int stackp;             /* stack pointer */
+BOARD_TLS int position_number;    /* position number */
 
 /* Some statistics gathered partly in board.c and hash.c */
-struct stats_data stats;
+BOARD_TLS struct stats_data stats;
 
 /* Variation tracking in SGF trees: */
 int count_variations  = 0;
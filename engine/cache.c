@@ -30,8 +30,16 @@
 #include <limits.h>
 #include <string.h>
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "liberty.h"
 #include "cache.h"
+#include "clock.h"
 #include "sgftree.h"
 
 
@@ -40,11 +48,14 @@
 /* ---------------------------------------------------------------- */
 
 static void tt_init(Transposition_table *table, int memsize);
-static void tt_clear(Transposition_table *table);
+static void tt_clear(Transposition_table *table, int all);
 
 /* The transposition table itself. */
 Transposition_table ttable;
 
+/* Statistics for ttable, see reading_cache_get_stats(). */
+static struct reading_cache_stats cache_stats;
+
 
 /* Arrays with random numbers for Zobrist hashing of input data (other
  * than the board position). If you add an array here, do not forget
@@ -85,43 +96,68 @@ calculate_hashval_for_tt(Hash_data *hashdata, int routine, int target1,
 
 
 /* Initialize the transposition table. Non-positive memsize means use
- * the default size of DEFAULT_NUMBER_OF_CACHE_ENTRIES entries.
+ * the default size of DEFAULT_NUMBER_OF_CACHE_ENTRIES entries. Otherwise
+ * the number of entries is the largest power of two fitting into
+ * memsize bytes, but at least one.
  */
 
 static void
 tt_init(Transposition_table *table, int memsize)
 {
-  int num_entries;
+  unsigned int num_entries;
  
   /* Make sure the hash system is initialized. */
   hash_init();
   keyhash_init();
 
-  if (memsize > 0)
-    num_entries = memsize / sizeof(table->entries[0]);
+  if (memsize > 0) {
+    num_entries = 1;
+    while (2 * num_entries * sizeof(table->entries[0]) <= (unsigned int) memsize)
+      num_entries *= 2;
+  }
   else
     num_entries = DEFAULT_NUMBER_OF_CACHE_ENTRIES;
 
   table->num_entries = num_entries;
-  table->entries     = malloc(num_entries * sizeof(table->entries[0]));
+  table->memory      = malloc(num_entries * sizeof(table->entries[0])
+			      + TT_ENTRY_ALIGNMENT - 1);
 
-  if (table->entries == NULL) {
+  if (table->memory == NULL) {
     perror("Couldn't allocate memory for transposition table. \n");
     exit(1);
   }
 
-  table->is_clean = 0;
-  tt_clear(table);
+  /* Align the entries to cache lines. */
+  table->entries = (Hashentry *) (((size_t) table->memory
+				   + TT_ENTRY_ALIGNMENT - 1)
+				  & ~((size_t) TT_ENTRY_ALIGNMENT - 1));
+
+  tt_clear(table, 1);
 }
 
 
-/* Clear the transposition table. */
+/* Clear the transposition table. Nodes from earlier generations are
+ * ignored, so only when the generation counter wraps around do we
+ * need to actually clear the memory. Nodes loaded from a snapshot
+ * survive unless all is set.
+ */
 
 static void
-tt_clear(Transposition_table *table)
+tt_clear(Transposition_table *table, int all)
 {
-  if (!table->is_clean) {
-    memset(table->entries, 0, table->num_entries * sizeof(table->entries[0]));
+  if (all) {
+    memset(table->entries, 0,
+	   table->num_entries * sizeof(table->entries[0]));
+    table->generation = 1;
+    table->is_clean = 1;
+  }
+  else if (!table->is_clean) {
+    table->generation++;
+    if (table->generation == TT_SNAPSHOT_GENERATION) {
+      memset(table->entries, 0,
+	     table->num_entries * sizeof(table->entries[0]));
+      table->generation = 1;
+    }
     table->is_clean = 1;
   }
 }
@@ -132,7 +168,120 @@ tt_clear(Transposition_table *table)
 void
 tt_free(Transposition_table *table)
 {
-  free(table->entries);
+  free(table->memory);
+}
+
+
+/* Find the entry for a hash value. */
+#define TT_ENTRY(table, hd) \
+  (&(table)->entries[(hd).hashval[0] & ((table)->num_entries - 1)])
+
+/* Whether a node with the given generation holds a valid result. */
+#define TT_IS_CURRENT(table, node_generation) \
+  ((node_generation) == (table)->generation \
+   || (node_generation) == TT_SNAPSHOT_GENERATION)
+
+
+/* Check whether a node holds a result of the current generation for
+ * the position with the given hash value and if so retrieve its data.
+ * Each field is read exactly once, so that a node being written by
+ * another thread at the same time fails the check instead of giving
+ * a mix of old and new data.
+ */
+static int
+tt_node_matches(Transposition_table *table, Hashnode *node,
+		Hash_data *hashval, unsigned int *data)
+{
+  volatile Hashnode *vnode = node;
+  Hashvalue check = vnode->key.hashval[0];
+  unsigned int node_data = vnode->data;
+  unsigned int generation = vnode->generation;
+  int k;
+
+  if (!TT_IS_CURRENT(table, generation)
+      || (check ^ HN_CHECK(node_data, generation)) != hashval->hashval[0])
+    return 0;
+
+  for (k = 1; k < NUM_HASHVALUES; k++)
+    if (vnode->key.hashval[k] != hashval->hashval[k])
+      return 0;
+
+  *data = node_data;
+  return 1;
+}
+
+
+/* Store data in a node. */
+static void
+tt_store_node(Hashnode *node, Hash_data *hashval, unsigned int data,
+	      unsigned int generation)
+{
+  volatile Hashnode *vnode = node;
+  int k;
+
+  for (k = 1; k < NUM_HASHVALUES; k++)
+    vnode->key.hashval[k] = hashval->hashval[k];
+  vnode->data = data;
+  vnode->generation = generation;
+  vnode->key.hashval[0] = hashval->hashval[0] ^ HN_CHECK(data, generation);
+}
+
+
+/* Ways to store a result, see tt_find_node(). */
+enum tt_slot {
+  TT_SLOT_DEEPER,
+  TT_SLOT_SAME,
+  TT_SLOT_EMPTY,
+  TT_SLOT_OTHER
+};
+
+/* Find the node in which to store a result with the given data for
+ * the position with the given hash value. An existing node for the
+ * same position is only overwritten by a result from at least the
+ * same remaining depth. Otherwise a node of an earlier generation is
+ * reused if there is one, or else the node with the lowest total cost
+ * of the entry is replaced. The return value tells which case it was,
+ * with *node set to NULL when a deeper result is kept.
+ */
+static enum tt_slot
+tt_find_node(Transposition_table *table, Hash_data *hashval,
+	     unsigned int data, Hashnode **node)
+{
+  Hashentry *entry = TT_ENTRY(table, *hashval);
+  Hashnode *replace = NULL;
+  unsigned int replace_cost = 0;
+  unsigned int old_data;
+  int k;
+
+  /* A stale node counts as having cost zero. */
+  for (k = 0; k < TT_ENTRY_SIZE; k++) {
+    volatile Hashnode *vnode = &entry->nodes[k];
+    unsigned int generation;
+    unsigned int cost;
+    if (tt_node_matches(table, &entry->nodes[k], hashval, &old_data)) {
+      if (hn_get_remaining_depth(data) < hn_get_remaining_depth(old_data)) {
+	*node = NULL;
+	return TT_SLOT_DEEPER;
+      }
+      *node = &entry->nodes[k];
+      return TT_SLOT_SAME;
+    }
+
+    generation = vnode->generation;
+    if (!TT_IS_CURRENT(table, generation))
+      cost = 0;
+    else
+      cost = hn_get_total_cost(vnode->data) + 1;
+    if (replace == NULL || cost < replace_cost) {
+      replace = &entry->nodes[k];
+      replace_cost = cost;
+    }
+  }
+
+  *node = replace;
+  if (replace_cost == 0)
+    return TT_SLOT_EMPTY;
+  return TT_SLOT_OTHER;
 }
 
 
@@ -152,7 +301,8 @@ tt_get(Transposition_table *table,
 {
   Hash_data hashval;
   Hashentry *entry;
-  Hashnode *node;
+  unsigned int data = 0;
+  int k;
  
   /* Sanity check. */
   if (remaining_depth < 0 || remaining_depth > HN_MAX_REMAINING_DEPTH)
@@ -161,29 +311,38 @@ tt_get(Transposition_table *table,
   /* Get the combined hash value. */
   calculate_hashval_for_tt(&hashval, routine, target1, target2, extra_hash);
 
+  cache_stats.lookups[routine]++;
+
   /* Get the correct entry and node. */
-  entry = &table->entries[hashdata_remainder(hashval, table->num_entries)];
-  if (hashdata_is_equal(hashval, entry->deepest.key))
-    node = &entry->deepest;
-  else if (hashdata_is_equal(hashval, entry->newest.key))
-    node = &entry->newest;
-  else
+  entry = TT_ENTRY(table, hashval);
+  for (k = 0; k < TT_ENTRY_SIZE; k++)
+    if (tt_node_matches(table, &entry->nodes[k], &hashval, &data))
+      break;
+  if (k == TT_ENTRY_SIZE) {
+    for (k = 0; k < TT_ENTRY_SIZE; k++)
+      if (TT_IS_CURRENT(table, entry->nodes[k].generation)) {
+	cache_stats.collisions++;
+	break;
+      }
     return 0;
+  }
 
   stats.read_result_hits++;
+  cache_stats.hits[routine]++;
 
   /* Return data.  Only set the result if remaining depth in the table
    * is big enough to be trusted.  The move can always be used for move
    * ordering if nothing else.
    */
   if (move)
-    *move = hn_get_move(node->data);
-  if (remaining_depth <= (int) hn_get_remaining_depth(node->data)) {
+    *move = hn_get_move(data);
+  if (remaining_depth <= (int) hn_get_remaining_depth(data)) {
     if (value1)
-      *value1 = hn_get_value1(node->data);
+      *value1 = hn_get_value1(data);
     if (value2)
-      *value2 = hn_get_value2(node->data);
+      *value2 = hn_get_value2(data);
     stats.trusted_read_result_hits++;
+    cache_stats.trusted_hits[routine]++;
     return 2;
   }
 
@@ -191,7 +350,8 @@ tt_get(Transposition_table *table,
 }
 
 
-/* Update a transposition table entry.
+/* Update a transposition table entry. See tt_find_node() for how the
+ * node to store the result in is chosen.
  */
 
 void
@@ -201,9 +361,7 @@ tt_update(Transposition_table *table,
 	  int value1, int value2, int move)
 {
   Hash_data hashval;
-  Hashentry *entry;
-  Hashnode *deepest;
-  Hashnode *newest;
+  Hashnode *node;
   unsigned int data;
   /* Get routine costs definitions from liberty.h. */
   static const int routine_costs[] = { ROUTINE_COSTS };
@@ -219,47 +377,25 @@ tt_update(Transposition_table *table,
   data = hn_create_data(remaining_depth, value1, value2, move,
       		        routine_costs[routine]);
 
-  /* Get the entry and nodes. */ 
-  entry = &table->entries[hashdata_remainder(hashval, table->num_entries)];
-  deepest = &entry->deepest;
-  newest  = &entry->newest;
- 
-  /* See if we found an already existing node. */
-  if (hashdata_is_equal(hashval, deepest->key)
-      && remaining_depth >= (int) hn_get_remaining_depth(deepest->data)) {
-
-    /* Found deepest */
-    deepest->data = data;
-
+  switch (tt_find_node(table, &hashval, data, &node)) {
+  case TT_SLOT_DEEPER:
+    cache_stats.deeper_kept++;
+    return;
+  case TT_SLOT_SAME:
+    cache_stats.updated++;
+    break;
+  case TT_SLOT_EMPTY:
+    cache_stats.empty_used++;
+    break;
+  case TT_SLOT_OTHER:
+    cache_stats.replaced++;
+    break;
   }
-  else if (hashdata_is_equal(hashval, newest->key)
-           && remaining_depth >= (int) hn_get_remaining_depth(newest->data)) {
 
-    /* Found newest */
-    newest->data = data;
+  tt_store_node(node, &hashval, data, table->generation);
 
-    /* If newest has become deeper than deepest, then switch them. */
-    if (hn_get_remaining_depth(newest->data)
-	> hn_get_remaining_depth(deepest->data)) {
-      Hashnode temp;
-
-      temp = *deepest;
-      *deepest = *newest;
-      *newest = temp;
-    }
-
-  }
-  else if (hn_get_total_cost(data) > hn_get_total_cost(deepest->data)) {
-    if (hn_get_total_cost(newest->data) < hn_get_total_cost(deepest->data))
-      *newest = *deepest;
-    deepest->key  = hashval;
-    deepest->data = data;
-  } 
-  else {
-    /* Replace newest. */
-    newest->key  = hashval;
-    newest->data = data;
-  }
+  cache_stats.entered[routine]++;
+  cache_stats.depths[remaining_depth]++;
 
   stats.read_result_entered++;
   table->is_clean = 0;
@@ -290,11 +426,21 @@ reading_cache_init(int bytes)
 }
 
 
-/* Clear the cache for read results. */
+/* Clear the cache for read results. Results loaded with
+ * reading_cache_load() are kept.
+ */
 void
 reading_cache_clear()
 {
-  tt_clear(&ttable);
+  tt_clear(&ttable, 0);
+}
+
+
+/* Clear the cache for read results, including loaded results. */
+void
+reading_cache_clear_all()
+{
+  tt_clear(&ttable, 1);
 }
 
 float
@@ -304,6 +450,263 @@ reading_cache_default_size()
 }
 
 
+/* Retrieve the statistics for the cache for read results, counted
+ * since the last call to reading_cache_reset_stats(). The number of
+ * used nodes is found by scanning the table.
+ */
+void
+reading_cache_get_stats(struct reading_cache_stats *s)
+{
+  unsigned int n;
+  int k;
+
+  *s = cache_stats;
+  s->num_nodes = ttable.num_entries * TT_ENTRY_SIZE;
+  s->used_nodes = 0;
+  for (n = 0; n < ttable.num_entries; n++)
+    for (k = 0; k < TT_ENTRY_SIZE; k++)
+      if (TT_IS_CURRENT(&ttable, ttable.entries[n].nodes[k].generation))
+	s->used_nodes++;
+}
+
+
+/* Reset the statistics for the cache for read results. */
+void
+reading_cache_reset_stats()
+{
+  memset(&cache_stats, 0, sizeof(cache_stats));
+}
+
+
+/* ================================================================ */
+/*                 Snapshots of the transposition table             */
+/* ---------------------------------------------------------------- */
+
+/* A snapshot file consists of this header followed by num_nodes
+ * Hashnodes with plain keys. Snapshots can only be used by a program
+ * with the same Zobrist hash values, which are identified by the
+ * random seed and a fingerprint of hash values computed from them,
+ * and with the same board size and level. The hash keys do not include
+ * the board size, so a position on a smaller board could otherwise be
+ * taken for one on a larger board.
+ */
+#define TT_SNAPSHOT_MAGIC "GNUGOTT"
+#define TT_SNAPSHOT_VERSION 2
+
+struct tt_snapshot_header {
+  char magic[8];
+  int version;
+  int hash_random_seed;
+  int max_board;
+  int boardmax;
+  int board_size;
+  int num_hashvalues;
+  int hashvalue_size;
+  int num_routines;
+  int level;
+  unsigned int num_nodes;
+  Hash_data fingerprint;
+};
+
+
+/* Compute a fingerprint of the Zobrist hash values in use, from the
+ * hash values of a fixed board position and of all other input data
+ * to the transposition table.
+ */
+static void
+tt_snapshot_fingerprint(Hash_data *fingerprint)
+{
+  Intersection fixed_board[BOARDSIZE];
+  int pos;
+  int k;
+
+  for (pos = 0; pos < BOARDSIZE; pos++)
+    fixed_board[pos] = (pos % 3 == 0 ? WHITE : pos % 3 == 1 ? BLACK : EMPTY);
+  hashdata_recalc(fingerprint, fixed_board, NO_MOVE);
+  for (pos = 0; pos < BOARDMAX; pos++) {
+    hashdata_xor(*fingerprint, target1_hash[pos]);
+    for (k = 0; k < NUM_HASHVALUES; k++)
+      fingerprint->hashval[k] += target2_hash[pos].hashval[k];
+  }
+  for (k = 0; k < NUM_CACHE_ROUTINES; k++)
+    hashdata_xor(*fingerprint, routine_hash[k]);
+}
+
+
+static void
+tt_snapshot_init_header(struct tt_snapshot_header *header,
+			unsigned int num_nodes)
+{
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, TT_SNAPSHOT_MAGIC, sizeof(header->magic));
+  header->version = TT_SNAPSHOT_VERSION;
+  header->hash_random_seed = HASH_RANDOM_SEED;
+  header->max_board = MAX_BOARD;
+  header->boardmax = BOARDMAX;
+  header->board_size = board_size;
+  header->num_hashvalues = NUM_HASHVALUES;
+  header->hashvalue_size = sizeof(Hashvalue);
+  header->num_routines = NUM_CACHE_ROUTINES;
+  header->level = get_level();
+  header->num_nodes = num_nodes;
+  tt_snapshot_fingerprint(&header->fingerprint);
+}
+
+
+/* Write the valid results in the cache for read results to filename.
+ * Return 1 on success and 0 if the file cannot be written.
+ */
+int
+reading_cache_save(const char *filename)
+{
+  struct tt_snapshot_header header;
+  Hashnode *nodes;
+  unsigned int num_nodes = 0;
+  unsigned int n;
+  FILE *outfile;
+  int success;
+  int k;
+
+  nodes = malloc(ttable.num_entries * TT_ENTRY_SIZE * sizeof(*nodes));
+  gg_assert(nodes);
+
+  for (n = 0; n < ttable.num_entries; n++)
+    for (k = 0; k < TT_ENTRY_SIZE; k++) {
+      Hashnode *node = &ttable.entries[n].nodes[k];
+      if (!TT_IS_CURRENT(&ttable, node->generation))
+	continue;
+      nodes[num_nodes] = *node;
+      nodes[num_nodes].key.hashval[0] ^= HN_CHECK(node->data,
+						  node->generation);
+      nodes[num_nodes].generation = 0;
+      num_nodes++;
+    }
+
+  tt_snapshot_init_header(&header, num_nodes);
+
+  outfile = fopen(filename, "wb");
+  if (!outfile) {
+    free(nodes);
+    return 0;
+  }
+  success = (fwrite(&header, sizeof(header), 1, outfile) == 1
+	     && fwrite(nodes, sizeof(*nodes), num_nodes, outfile) == num_nodes);
+  if (fclose(outfile) != 0)
+    success = 0;
+
+  free(nodes);
+  return success;
+}
+
+
+/* Map the contents of a file into memory, or read it if mmap() is
+ * unavailable. Return NULL on failure.
+ */
+static void *
+tt_snapshot_map(const char *filename, size_t *size)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  struct stat file_stat;
+  void *contents;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  *size = file_stat.st_size;
+  contents = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (contents == MAP_FAILED)
+    return NULL;
+  return contents;
+#else
+  void *contents;
+  long length;
+  FILE *infile = fopen(filename, "rb");
+
+  if (!infile)
+    return NULL;
+  if (fseek(infile, 0, SEEK_END) != 0
+      || (length = ftell(infile)) <= 0
+      || fseek(infile, 0, SEEK_SET) != 0) {
+    fclose(infile);
+    return NULL;
+  }
+  *size = length;
+  contents = malloc(*size);
+  if (contents && fread(contents, 1, *size, infile) != *size) {
+    free(contents);
+    contents = NULL;
+  }
+  fclose(infile);
+  return contents;
+#endif
+}
+
+
+static void
+tt_snapshot_unmap(void *contents, size_t size)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+  munmap(contents, size);
+#else
+  UNUSED(size);
+  free(contents);
+#endif
+}
+
+
+/* Load the results of a snapshot written by reading_cache_save() into
+ * the cache for read results. They are added to the results already
+ * there, and unlike those they survive reading_cache_clear(). Return
+ * 1 on success and 0 if the file cannot be read or was written with
+ * other hash values, board size or level.
+ */
+int
+reading_cache_load(const char *filename)
+{
+  struct tt_snapshot_header expected;
+  const struct tt_snapshot_header *header;
+  const Hashnode *nodes;
+  void *contents;
+  size_t size;
+  unsigned int n;
+
+  contents = tt_snapshot_map(filename, &size);
+  if (!contents)
+    return 0;
+
+  header = contents;
+  if (size < sizeof(*header)) {
+    tt_snapshot_unmap(contents, size);
+    return 0;
+  }
+
+  tt_snapshot_init_header(&expected, header->num_nodes);
+  if (memcmp(header, &expected, sizeof(expected)) != 0
+      || (size - sizeof(*header)) / sizeof(*nodes) != header->num_nodes
+      || (size - sizeof(*header)) % sizeof(*nodes) != 0) {
+    tt_snapshot_unmap(contents, size);
+    return 0;
+  }
+
+  nodes = (const Hashnode *) (header + 1);
+  for (n = 0; n < header->num_nodes; n++) {
+    Hash_data key = nodes[n].key;
+    Hashnode *node;
+    if (tt_find_node(&ttable, &key, nodes[n].data, &node) != TT_SLOT_DEEPER)
+      tt_store_node(node, &key, nodes[n].data, TT_SNAPSHOT_GENERATION);
+  }
+  ttable.is_clean = 0;
+
+  tt_snapshot_unmap(contents, size);
+  return 1;
+}
+
+
 /* Write reading trace data to an SGF file. Normally called through the
  * macro SGFTRACE in cache.h.
  */
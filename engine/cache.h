@@ -56,20 +56,47 @@
  *   remaining_depth:  5 bits (depth - stackp)  NOTE: HN_MAX_REMAINING_DEPTH
  *
  *   The last 9 bits together give an index for the total costs.
+ *
+ * The generation tells which clearing of the table the node belongs
+ * to. Nodes from earlier generations are treated as empty. It fits
+ * into what would otherwise be padding with 64 bit hash values.
+ *
+ * The nodes are read and written without locking. To detect nodes
+ * torn by simultaneous writes from different threads, the first word
+ * of the key is stored xored with the data and the generation, see
+ * HN_CHECK(). A node whose fields don't belong together then simply
+ * fails to match.
  */
 typedef struct {
   Hash_data key;
   unsigned int data; /* Should be 32 bits, but only wastes 25% if 64 bits. */
+  unsigned int generation;
 } Hashnode;
 
+/* Must stay below the size of the depths array in struct
+ * reading_cache_stats.
+ */
 #define HN_MAX_REMAINING_DEPTH 31
 
+/* Value xored into the first word of the key of a node. */
+#define HN_CHECK(data, generation) \
+  ((Hashvalue) (data) \
+   ^ ((Hashvalue) (generation) << (CHAR_BIT * SIZEOF_HASHVALUE / 2)))
+
+
+/* Number of nodes in each entry of the transposition table. With 64
+ * bit hash values an entry fills exactly one 64 byte cache line.
+ */
+#define TT_ENTRY_SIZE 4
+
+/* Entries are aligned to this number of bytes. */
+#define TT_ENTRY_ALIGNMENT 64
 
-/* Hashentry: an entry, with two nodes of the hash_table
+/* Hashentry: an entry of the hash table, with a set of nodes for
+ * positions which map to the same index.
  */
 typedef struct {
-  Hashnode deepest;
-  Hashnode newest;
+  Hashnode nodes[TT_ENTRY_SIZE];
 } Hashentry;
 
 /* Hn is for hash node. */
@@ -88,19 +115,35 @@ typedef struct {
    | (((remaining_depth & 0x1f)  <<  0)))
 
 
-/* Transposition_table: transposition table used for caching. */
+/* Transposition_table: transposition table used for caching.
+ *
+ * The number of entries is a power of two, so that the index is given
+ * by the low bits of the hash value. The table is cleared by
+ * increasing the generation.
+ *
+ * tt_get() and tt_update() may be called from several threads at
+ * once, but not at the same time as the table is cleared. The read
+ * result statistics are not updated atomically and may then be off.
+ */
 typedef struct {
   unsigned int num_entries;
   Hashentry *entries;
+  void *memory;              /* Allocated block containing the entries. */
+  unsigned int generation;
   int is_clean;
 } Transposition_table;
 
 extern Transposition_table ttable;
 
+/* Generation of nodes loaded with reading_cache_load(). These are
+ * valid in every generation of the table.
+ */
+#define TT_SNAPSHOT_GENERATION UINT_MAX
+
 /* Number of cache entries to use by default if no cache memory usage
- * has been set explicitly.
+ * has been set explicitly. Must be a power of two.
  */
-#define DEFAULT_NUMBER_OF_CACHE_ENTRIES 350000
+#define DEFAULT_NUMBER_OF_CACHE_ENTRIES (1 << 18)
 
 void tt_free(Transposition_table *table);
 int  tt_get(Transposition_table *table, enum routine_id routine,
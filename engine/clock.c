@@ -269,6 +269,57 @@ clock_push_button(int color)
 }
 
 
+/**********************/
+/*  Time budgeting    */
+/**********************/
+
+/* Seconds kept in reserve for communication delays and overhead
+ * outside the move generation.
+ */
+#define TIME_SAFETY_MARGIN 0.5
+
+/* Estimate how much time color can afford to spend on the next move,
+ * in seconds. Return 0.0 if there are no time limits.
+ *
+ * In main time the remaining time is spread over the number of moves
+ * we aim to play, estimated in the same way as in
+ * analyze_time_data(). With byo-yomi we may additionally use what one
+ * move in a byo-yomi period would get. In byo-yomi the remaining time
+ * is spread over the stones left in the period.
+ */
+double
+time_for_next_move(int color)
+{
+  struct remaining_time_data *const timer
+    = (color == BLACK) ? &black_time_data.estimated
+	               : &white_time_data.estimated;
+  double time_left = gg_max(timer->time_left, 0.0);
+  double budget;
+
+  if (!have_time_settings())
+    return 0.0;
+
+  if (timer->stones > 0)
+    budget = time_left / timer->stones;
+  else {
+    int nominal_moves = board_size * board_size / 3;
+    int moves_left = gg_max(nominal_moves - movenum / 2,
+			    2 * nominal_moves / 5);
+    budget = time_left / gg_max(moves_left, 1);
+    if (byoyomi_time > 0 && byoyomi_stones > 0)
+      budget += (double) byoyomi_time / byoyomi_stones;
+  }
+
+  budget -= TIME_SAFETY_MARGIN;
+
+  /* Always allow some thinking, even when the clock is nearly out. */
+  if (budget < 0.1)
+    budget = 0.1;
+
+  return budget;
+}
+
+
 /**********************/
 /*  Autolevel system  */
 /**********************/
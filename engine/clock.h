@@ -35,6 +35,7 @@ void clock_push_button(int color);
 void update_time_left(int color, int time_left, int stones);
 void clock_print(int color);
 int have_time_settings(void);
+double time_for_next_move(int color);
 
 void adjust_level_offset(int color);
 
@@ -44,6 +44,9 @@
 static int limit_search = 0;
 static int search_mask[BOARDMAX];
 
+/* Wall clock time when the current move generation started. */
+static double genmove_start_time = 0.0;
+
 static int do_genmove(int color, float pure_threat_value,
 		      int allowed_moves[BOARDMAX], float *value, int *resign);
 
@@ -317,6 +320,7 @@ monte_carlo_genmove(int color, int allowed_moves[BOARDMAX],
   int frequency_cutoff;
   int frequency_cutoff2;
   int number_of_simulations;
+  double time_limit = 0.0;
 
   memset(move_values, 0, sizeof(move_values));
   memset(move_frequencies, 0, sizeof(move_frequencies));
@@ -343,9 +347,20 @@ monte_carlo_genmove(int color, int allowed_moves[BOARDMAX],
       forbidden_move[pos] = 0;
 
   number_of_simulations = mc_games_per_level * gg_max(get_level(), 1);
+
+  /* With a clock driven search, use whatever remains of the time
+   * budget for this move.
+   */
+  if (mc_use_clock && have_time_settings()) {
+    time_limit = (time_for_next_move(color)
+		  - (gg_gettimeofday() - genmove_start_time));
+    if (time_limit < 0.05)
+      time_limit = 0.05;
+  }
   
   uct_genmove(color, &best_uct_move, forbidden_move, allowed_moves,
-	      number_of_simulations, move_values, move_frequencies);
+	      number_of_simulations, time_limit,
+	      move_values, move_frequencies);
 
   best_move = best_uct_move;
   best_value = 0.0;
@@ -395,6 +410,7 @@ do_genmove(int color, float pure_threat_value,
   if (!value)
     value = &dummy_value;
 
+  genmove_start_time = gg_gettimeofday();
   start_timer(0);
   clearstats();
 
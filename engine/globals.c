@@ -135,6 +135,40 @@ int mc_games_per_level = 8000;  /* By default, use 8000 times the current
 				 * for each mmove when Monte Carlo
 				 * move generation is enabled.
 				 */
+int mc_threads = 1;             /* Number of threads used by the Monte
+				 * Carlo search.
+				 */
+int mc_use_clock = 0;           /* Default is to run a fixed number of
+				 * simulations rather than timing the
+				 * Monte Carlo search by the clock.
+				 */
+int mc_ponder = 0;              /* Default is not to ponder. */
+int mc_rave_equivalence = 0;    /* Number of games at which the AMAF
+				 * (RAVE) values and the ordinary values
+				 * of UCT nodes weigh about equally. Zero
+				 * turns RAVE off, which is the default.
+				 */
+float mc_memory = 0.0;          /* Memory in megabytes for the UCT tree.
+				 * By default it is sized from the
+				 * number of simulations.
+				 */
+int mc_widening = 0;            /* Games needed before a UCT node gets a
+				 * second child with progressive
+				 * widening. Zero, the default, turns
+				 * progressive widening off.
+				 */
+int mc_ladders = 0;             /* Default is not to read ladders in
+				 * the Monte Carlo simulations.
+				 */
+int persistent_cache_entries = 0; /* Entries in each persistent cache.
+				   * Zero, the default, keeps the
+				   * compiled in sizes.
+				   */
+float persistent_cache_memory = 0.0; /* Megabytes shared by the
+				      * persistent caches, zero if
+				      * they are only bounded in
+				      * entries.
+				      */
 
 float best_move_values[10];
 int   best_moves[10];
@@ -221,6 +221,15 @@ extern int mirror_stones_limit;      /* but stop at this number of stones */
 extern int gtp_version;              /* version of Go Text Protocol */
 extern int use_monte_carlo_genmove;  /* use Monte Carlo move generation */
 extern int mc_games_per_level;       /* number of Monte Carlo simulations per level */
+extern int mc_threads;               /* number of Monte Carlo search threads */
+extern int mc_use_clock;             /* time Monte Carlo search by the clock */
+extern int mc_ponder;                /* Monte Carlo search on opponent's time */
+extern int mc_rave_equivalence;      /* weight of AMAF values in UCT search */
+extern float mc_memory;              /* megabytes for the UCT tree, 0 if unbounded */
+extern int mc_widening;              /* games to unlock second UCT child */
+extern int mc_ladders;               /* read ladders in Monte Carlo playouts */
+extern int persistent_cache_entries; /* entries per persistent cache, 0 for default */
+extern float persistent_cache_memory; /* megabytes for persistent caches, 0 if unbounded */
 
 /* Mandatory values of reading parameters. Normally -1, if set
  * these override the values derived from the level. */
@@ -83,8 +83,6 @@ typedef struct {
   Hashvalue hashval[NUM_HASHVALUES];
 } Hash_data;
 
-extern Hash_data board_hash;
-
 Hash_data goal_to_hashvalue(const signed char *goal);
 
 void hash_init_zobrist_array(Hash_data *array, int size);
@@ -197,7 +197,29 @@ void dfa_match_init(void);
 
 void reading_cache_init(int bytes);
 void reading_cache_clear(void);
+void reading_cache_clear_all(void);
 float reading_cache_default_size(void);
+int reading_cache_save(const char *filename);
+int reading_cache_load(const char *filename);
+
+/* Statistics for the transposition table of read results. */
+struct reading_cache_stats {
+  int lookups[NUM_CACHE_ROUTINES];      /* Lookups per routine. */
+  int hits[NUM_CACHE_ROUTINES];         /* Results found. */
+  int trusted_hits[NUM_CACHE_ROUTINES]; /* Results with enough depth. */
+  int entered[NUM_CACHE_ROUTINES];      /* Results stored. */
+  int collisions;  /* Lookups missing in an entry with other positions. */
+  int updated;     /* Results replacing one for the same position. */
+  int deeper_kept; /* Results not stored since a deeper one existed. */
+  int empty_used;  /* Results stored in empty or stale nodes. */
+  int replaced;    /* Results replacing one for another position. */
+  int depths[32];  /* Stored results by remaining depth. */
+  int num_nodes;   /* Number of nodes in the table. */
+  int used_nodes;  /* Nodes holding results since the last clearing. */
+};
+
+void reading_cache_get_stats(struct reading_cache_stats *cache_stats);
+void reading_cache_reset_stats(void);
 
 /* reading.c */
 int attack(int str, int *move);
@@ -501,12 +523,52 @@ enum dragon_status aftermath_final_status(int color, int pos);
 int mc_get_size_of_pattern_values_table(void);
 int mc_load_patterns_from_db(const char *filename, unsigned int *values);
 void mc_init_patterns(const unsigned int *values);
-int choose_mc_patterns(char *name);
+void mc_get_patterns(unsigned int *values);
+int choose_mc_patterns(const char *name);
+const char *mc_pattern_database_name(int k);
 void list_mc_patterns(void);
 
+/* Results of mc_benchmark(). The times are in seconds, for all the
+ * playouts together.
+ */
+struct mc_benchmark_result {
+  double playouts_per_second;
+  double average_length;
+  double total_time;
+  double play_move_time;
+  double update_move_values_time;
+  double generate_random_move_time;
+};
+
+void mc_benchmark(int color, int num_playouts,
+		  struct mc_benchmark_result *result);
+
 void uct_genmove(int color, int *move, int *forbidden_moves,
-		 int *allowed_moves, int nodes, float *move_values,
-		 int *move_frequencies);
+		 int *allowed_moves, int games, double time_limit,
+		 float *move_values, int *move_frequencies);
+void uct_ponder_start(int color);
+void uct_ponder_stop(void);
+
+/* A root move of a running Monte Carlo analysis. The win rate is for
+ * the color to move and the score statistics are from its point of
+ * view as well. The principal variation starts with the move itself.
+ */
+#define MC_ANALYSIS_PV_LENGTH 10
+
+struct mc_analysis_move {
+  int move;
+  int games;
+  float winrate;
+  float score_mean;
+  float score_stddev;
+  int pv_length;
+  int pv[MC_ANALYSIS_PV_LENGTH];
+};
+
+int uct_analyze_start(int color, double interval, void (*report)(void));
+void uct_analyze_stop(void);
+int uct_get_analysis(struct mc_analysis_move *moves, int max_moves);
+int uct_dump_search_tree(const char *filename);
 
 int owl_attack(int target, int *attack_point, int *certain, int *kworm);
 int owl_defend(int target, int *defense_point, int *certain, int *kworm);
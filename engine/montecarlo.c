@@ -30,10 +30,21 @@
 #include "liberty.h"
 #include "sgftree.h"
 #include "gg_utils.h"
+#include "uctdump.h"
 
 #include "random.h"
 #include <math.h>
 
+/* The UCT search can be run in multiple threads if pthreads and the
+ * GCC atomic builtins are available.
+ */
+#if defined(HAVE_PTHREAD_H) && defined(__GNUC__)
+#define UCT_THREADS 1
+#include <pthread.h>
+#else
+#define UCT_THREADS 0
+#endif
+
 /* FIXME: Replace with a DEBUG_MC symbol for use with -d. */
 static int mc_debug = 0;
 
@@ -1357,6 +1368,14 @@ mc_init_patterns(const unsigned int *values)
 }
 
 
+/* Copy the local pattern values in use to values. */
+void
+mc_get_patterns(unsigned int *values)
+{
+  memcpy(values, mc_patterns.values, sizeof(mc_patterns.values));
+}
+
+
 /* Initialize the data structures used to keep track of the local
  * pattern values.
  */
@@ -1513,6 +1532,263 @@ mc_update_move_values(struct mc_board *mc)
 }
 
 
+/******************* Ladder reading ***********************/
+
+/* A small and cheap ladder reader working directly on copies of the
+ * mc_board stone array. It only follows the plain ladder sequence
+ * where the attacker keeps giving atari and the defender keeps
+ * extending. Whenever something else happens, e.g. the defender can
+ * capture one of the attacking strings or the reading grows too
+ * large, the ladder is assumed not to work. Thus it errs on the side
+ * of not vetoing escape moves in the playouts.
+ */
+
+/* Maximum number of stones placed when reading a single ladder. */
+#define MC_LADDER_MAX_NODES 64
+
+/* Maximum number of ladder escapes vetoed when generating a move. */
+#define MC_LADDER_MAX_VETOES 4
+
+/* Number of entries in the ladder result cache. Power of two. */
+#define MC_LADDER_CACHE_SIZE 1024
+
+/* Cached ladder results, keyed by the hash value of the position
+ * after the escape move. A result of 0 marks an unused entry,
+ * otherwise it is one more than the ladder status.
+ */
+struct mc_ladder_cache {
+  Hashvalue keys[MC_LADDER_CACHE_SIZE];
+  unsigned char results[MC_LADDER_CACHE_SIZE];
+};
+
+struct mc_ladder_reader {
+  int marks[BOARDSIZE];
+  int mark;
+  int nodes;
+};
+
+
+/* Find up to maxlibs liberties of the string at str. The number of
+ * liberties found is returned.
+ */
+static int
+mc_ladder_liberties(struct mc_ladder_reader *reader, Intersection *board,
+		    int str, int maxlibs, int *libs)
+{
+  int stack[BOARDMAX];
+  int stack_size = 0;
+  int color = board[str];
+  int num_libs = 0;
+  int k;
+
+  reader->mark++;
+  reader->marks[str] = reader->mark;
+  stack[stack_size++] = str;
+  while (stack_size > 0) {
+    int pos = stack[--stack_size];
+    for (k = 0; k < 4; k++) {
+      int pos2 = pos + delta[k];
+      if (reader->marks[pos2] == reader->mark)
+	continue;
+      if (board[pos2] == EMPTY) {
+	reader->marks[pos2] = reader->mark;
+	libs[num_libs++] = pos2;
+	if (num_libs >= maxlibs)
+	  return num_libs;
+      }
+      else if (board[pos2] == color) {
+	reader->marks[pos2] = reader->mark;
+	stack[stack_size++] = pos2;
+      }
+    }
+  }
+
+  return num_libs;
+}
+
+
+/* Return 1 if some string of the opposite color adjacent to the
+ * string at str is in atari.
+ */
+static int
+mc_ladder_neighbor_in_atari(struct mc_ladder_reader *reader,
+			    Intersection *board, int str)
+{
+  int stones[BOARDMAX];
+  int num_stones = 0;
+  int color = board[str];
+  int libs[2];
+  int k;
+  int r;
+
+  /* First collect the stones, as the liberty counting below reuses
+   * the marks.
+   */
+  reader->mark++;
+  reader->marks[str] = reader->mark;
+  stones[num_stones++] = str;
+  for (r = 0; r < num_stones; r++)
+    for (k = 0; k < 4; k++) {
+      int pos2 = stones[r] + delta[k];
+      if (board[pos2] == color && reader->marks[pos2] != reader->mark) {
+	reader->marks[pos2] = reader->mark;
+	stones[num_stones++] = pos2;
+      }
+    }
+
+  for (r = 0; r < num_stones; r++)
+    for (k = 0; k < 4; k++) {
+      int pos2 = stones[r] + delta[k];
+      if (board[pos2] == OTHER_COLOR(color)
+	  && mc_ladder_liberties(reader, board, pos2, 2, libs) == 1)
+	return 1;
+    }
+
+  return 0;
+}
+
+
+static int mc_ladder_defend(struct mc_ladder_reader *reader,
+			    Intersection *board, int str);
+
+/* The string at str has two liberties and the opponent is to move.
+ * Return 1 if the string can be captured in a ladder.
+ */
+static int
+mc_ladder_attack(struct mc_ladder_reader *reader, Intersection *board,
+		 int str)
+{
+  Intersection new_board[BOARDSIZE];
+  int attacker = OTHER_COLOR(board[str]);
+  int libs[2];
+  int other_libs[2];
+  int k;
+
+  if (mc_ladder_liberties(reader, board, str, 2, libs) != 2)
+    return 0;
+
+  for (k = 0; k < 2; k++) {
+    if (++reader->nodes > MC_LADDER_MAX_NODES)
+      return 0;
+    memcpy(new_board, board, sizeof(new_board));
+    new_board[libs[k]] = attacker;
+    /* An atari with a stone which can be captured right away does
+     * not work.
+     */
+    if (mc_ladder_liberties(reader, new_board, libs[k], 2, other_libs) < 2)
+      continue;
+    if (mc_ladder_defend(reader, new_board, str))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* The string at str is in atari and is to move. Return 1 if it can't
+ * escape the ladder.
+ */
+static int
+mc_ladder_defend(struct mc_ladder_reader *reader, Intersection *board,
+		 int str)
+{
+  Intersection new_board[BOARDSIZE];
+  int color = board[str];
+  int libs[3];
+  int lib;
+  int num_libs;
+  int k;
+
+  if (mc_ladder_liberties(reader, board, str, 2, libs) != 1)
+    return 0;
+  lib = libs[0];
+
+  if (mc_ladder_neighbor_in_atari(reader, board, str))
+    return 0;
+
+  if (++reader->nodes > MC_LADDER_MAX_NODES)
+    return 0;
+  memcpy(new_board, board, sizeof(new_board));
+  new_board[lib] = color;
+
+  /* Extending may still capture an attacking string which is not
+   * adjacent to the defender.
+   */
+  for (k = 0; k < 4; k++)
+    if (new_board[lib + delta[k]] == OTHER_COLOR(color)
+	&& mc_ladder_liberties(reader, new_board, lib + delta[k], 1, libs) == 0)
+      return 0;
+
+  num_libs = mc_ladder_liberties(reader, new_board, str, 3, libs);
+  if (num_libs <= 1)
+    return 1;
+  if (num_libs >= 3)
+    return 0;
+
+  return mc_ladder_attack(reader, new_board, str);
+}
+
+
+/* Return 1 if a move by color at move extends a string out of atari
+ * only to be captured in a ladder. Results are stored in cache
+ * unless it is NULL.
+ */
+static int
+mc_is_ladder_escape(struct mc_board *mc, int move, int color,
+		    struct mc_ladder_cache *cache)
+{
+  struct mc_ladder_reader reader;
+  Intersection board[BOARDSIZE];
+  Hash_data hash;
+  int index = 0;
+  int libs[3];
+  int result;
+  int own_captures;
+  int opponent_captures;
+
+  /* Only consider moves at the last liberty of a string in atari which
+   * don't capture anything themselves.
+   */
+  if (color == WHITE) {
+    own_captures = (mc->local_context[move] >> 16) & 3;
+    opponent_captures = (mc->local_context[move] >> 18) & 3;
+  }
+  else {
+    own_captures = (mc->local_context[move] >> 18) & 3;
+    opponent_captures = (mc->local_context[move] >> 16) & 3;
+  }
+  if (opponent_captures == 0 || own_captures > 0)
+    return 0;
+
+  if (cache) {
+    hash = mc->hash;
+    hashdata_invert_stone(&hash, move, color);
+    index = hash.hashval[0] & (MC_LADDER_CACHE_SIZE - 1);
+    if (cache->results[index] != 0
+	&& cache->keys[index] == hash.hashval[0])
+      return cache->results[index] - 1;
+  }
+
+  memcpy(board, mc->board, sizeof(board));
+  board[move] = color;
+  memset(reader.marks, 0, sizeof(reader.marks));
+  reader.mark = 0;
+  reader.nodes = 0;
+
+  if (mc_ladder_liberties(&reader, board, move, 3, libs) != 2)
+    result = 0;
+  else
+    result = mc_ladder_attack(&reader, board, move);
+
+  if (cache) {
+    cache->keys[index] = hash.hashval[0];
+    cache->results[index] = result + 1;
+  }
+
+  return result;
+}
+
+
 /***************************************************/
 
 #define ASSERT_LEGAL 1
@@ -1526,9 +1802,25 @@ struct mc_game {
   int consecutive_passes;
   int consecutive_ko_captures;
   int depth;
+  /* Private random number generator state, used by playouts running
+   * in parallel threads. If NULL, the global generator is used.
+   */
+  struct gg_rand_state *rand_state;
+  /* Cache of ladder results when reading ladders, or NULL. */
+  struct mc_ladder_cache *ladder_cache;
 };
 
 
+/* Obtain a random number for the playout in game. */
+static double
+mc_drand(struct mc_game *game)
+{
+  if (game->rand_state)
+    return gg_drand_r(game->rand_state);
+  return gg_drand();
+}
+
+
 /* Generate a random move. */
 static int
 mc_generate_random_move(struct mc_game *game)
@@ -1548,6 +1840,9 @@ mc_generate_random_move(struct mc_game *game)
   int *partition_lists;
   unsigned int *move_value_sum;
   unsigned int saved_ko_value = 0;
+  int vetoed_moves[MC_LADDER_MAX_VETOES];
+  unsigned int saved_vetoed_values[MC_LADDER_MAX_VETOES];
+  int num_vetoed_moves = 0;
   int partition;
   int move;
   int k;
@@ -1627,13 +1922,18 @@ mc_generate_random_move(struct mc_game *game)
   }
   
   /* Sample a move randomly according to the distribution given by
-   * the move values.
+   * the move values. When reading ladders, escapes from atari which
+   * only run into a working ladder are vetoed by temporarily clearing
+   * their move values and sampling again.
    */
-  if (*move_value_sum == 0)
-    move = PASS_MOVE;
-  else {
+  while (1) {
+    if (*move_value_sum == 0) {
+      move = PASS_MOVE;
+      break;
+    }
+
     /* First choose a partition. */
-    x = (int) (gg_drand() * *move_value_sum);
+    x = (int) (mc_drand(game) * *move_value_sum);
     for (k = 0; k < NUM_MOVE_PARTITIONS; k++) {
       x -= partition_sums[k];
       if (x < 0)
@@ -1641,7 +1941,7 @@ mc_generate_random_move(struct mc_game *game)
     }
 
     /* Then choose a move in that partition. */
-    x = (unsigned int) (gg_drand() * partition_sums[k]);
+    x = (unsigned int) (mc_drand(game) * partition_sums[k]);
     for (pos = partition_lists[k]; pos != 1; pos = partition_lists[pos]) {
       x -= move_values[pos];
       if (x < 0)
@@ -1654,6 +1954,28 @@ mc_generate_random_move(struct mc_game *game)
     ASSERT1(move == PASS_MOVE || mc->board[move] == EMPTY, move);
     ASSERT1(mc_is_legal(mc, move, color), move);
 #endif
+
+    if (!mc_ladders
+	|| move == PASS_MOVE
+	|| num_vetoed_moves == MC_LADDER_MAX_VETOES
+	|| !mc_is_ladder_escape(mc, move, color, game->ladder_cache))
+      break;
+
+    partition = move & (NUM_MOVE_PARTITIONS - 1);
+    saved_vetoed_values[num_vetoed_moves] = move_values[move];
+    vetoed_moves[num_vetoed_moves++] = move;
+    partition_sums[partition] -= move_values[move];
+    *move_value_sum -= move_values[move];
+    move_values[move] = 0;
+  }
+
+  /* Reset the values of vetoed ladder escapes. */
+  for (k = num_vetoed_moves - 1; k >= 0; k--) {
+    pos = vetoed_moves[k];
+    partition = pos & (NUM_MOVE_PARTITIONS - 1);
+    move_values[pos] = saved_vetoed_values[k];
+    partition_sums[partition] += saved_vetoed_values[k];
+    *move_value_sum += saved_vetoed_values[k];
   }
 
   /* Reset the value of an illegal ko capture. */
@@ -1750,6 +2072,39 @@ static int mc_play_random_game(struct mc_game *game)
 
 #define UCT_MAX_SEARCH_DEPTH BOARDMAX
 
+/* Number of locks protecting the floating point score sums and the
+ * child arrays of the nodes when searching with multiple threads.
+ * Nodes are mapped to the locks by their index.
+ */
+#define UCT_NUM_NODE_LOCKS 64
+
+/* Size of the arc pool, relative to the node pool, and the initial
+ * size of the child array of a node. Child arrays double in size when
+ * they fill up.
+ */
+#define UCT_ARCS_PER_NODE 4
+#define UCT_INITIAL_CHILDREN 2
+
+/* Growth in the number of games needed to unlock each further child
+ * with progressive widening.
+ */
+#define UCT_WIDENING_FACTOR 1.4
+
+/* When a memory bounded tree fills up, low-visit nodes are discarded
+ * until at most this fraction of the pool remains in use.
+ */
+#define UCT_RECYCLE_FRACTION 0.5
+
+/* Visit counts up to this are told apart when choosing which nodes
+ * to discard.
+ */
+#define UCT_RECYCLE_MAX_GAMES 4096
+
+/* How often, in simulations, a time limited search checks whether the
+ * best move can still change.
+ */
+#define UCT_DECISION_CHECK_INTERVAL 128
+
 struct bitboard {
   /* FIXME: Do this properly. */
   unsigned int bits[1 + BOARDMAX / 32];
@@ -1758,19 +2113,45 @@ struct bitboard {
 struct uct_arc {
   int move;
   struct uct_node *node;
-  struct uct_arc *next;
 };
 
+/* Besides the ordinary statistics, each node has all-moves-as-first
+ * (AMAF) statistics for the move leading to it, counting every
+ * simulation through the parent in which that move was played first
+ * by the same color, at any later point. These are blended into the
+ * move selection when mc_rave_equivalence is nonzero.
+ */
 struct uct_node {
   int wins;
   int games;
+  int amaf_wins;
+  int amaf_games;
   float sum_scores;
   float sum_scores2;
-  struct uct_arc *child;
+  /* The children are kept in a contiguous array, with the newest
+   * child last. They are scanned from the newest.
+   */
+  struct uct_arc *children;
+  int num_children;
+  int max_children;
   struct bitboard untested;
   Hash_data boardhash;
 };
 
+/* The search tree is shared by all search threads. Nodes and child
+ * arrays are allocated from the pools by atomically bumping
+ * num_used_nodes and num_used_arcs, and new nodes are published in
+ * the hash tables with compare-and-swap. Wins and games are updated
+ * atomically, whereas the score sums and additions to the child
+ * arrays are protected by striped locks. A child array which has to
+ * grow is copied to a new block in the pool, leaving the old one
+ * intact for threads still reading it.
+ *
+ * A thread descending the tree increases the games count of each
+ * visited node before the outcome of the simulation is known. Until
+ * then the visit counts as a loss, which discourages other threads
+ * from following the same path ("virtual loss").
+ */
 struct uct_tree {
   struct uct_node *nodes;
   struct uct_arc *arcs;
@@ -1781,52 +2162,286 @@ struct uct_tree {
   int num_used_nodes;
   int num_arcs;
   int num_used_arcs;
-  int *forbidden_moves;
+  int forbidden_moves[BOARDMAX];
+  struct mc_game starting_position;
+  int root_color;
+  float komi;
+  int board_size;
+  int num_threads;
+  double start_time;
+  double deadline;
+  int start_games;
+  int max_games;
+  /* If nonzero, the tree has a fixed memory budget and low-visit
+   * nodes are recycled when it fills up.
+   */
+  int recycle;
+  /* If nonzero, the deadline only ends a time slice of an analysis,
+   * so the search is not cut short when the best move is decided.
+   */
+  int analyzing;
+  volatile int full;
+  volatile int stop;
+#if UCT_THREADS
+  /* The position searched, for the threads other than the calling
+   * one, which start out with an empty board of their own.
+   */
+  struct board_state board_state;
+#endif
+};
+
+/* The tree is kept between moves, so that the part of it which is
+ * still relevant can be reused by the next search.
+ */
+static struct uct_tree uct_persistent_tree;
+
+/* Private data for each search thread. */
+struct uct_worker {
+  struct uct_tree *tree;
   struct mc_game game;
+  struct gg_rand_state rand_state;
+  struct mc_ladder_cache ladder_cache;
+  int num_new_arcs;
+  int lost_race;       /* Another thread added the same arc first. */
   int move_score[BOARDSIZE];
   int move_ordering[BOARDSIZE];
   int inverse_move_ordering[BOARDSIZE];
   int num_ordered_moves;
+  /* Depth of the first occurrence of each move in the simulation,
+   * from the depth of the node being updated and on.
+   */
+  int amaf_depth[BOARDMAX];
 };
 
+#if UCT_THREADS
+static pthread_mutex_t uct_node_locks[UCT_NUM_NODE_LOCKS];
+#endif
+
+
+/* Atomically add n to *x and return the previous value. */
+static int
+uct_fetch_and_add(int *x, int n)
+{
+#if UCT_THREADS
+  return __sync_fetch_and_add(x, n);
+#else
+  int old = *x;
+  *x += n;
+  return old;
+#endif
+}
+
+
+/* Atomically clear the bits of *x given by mask and return the
+ * previous value.
+ */
+static unsigned int
+uct_fetch_and_clear_bits(unsigned int *x, unsigned int mask)
+{
+#if UCT_THREADS
+  return __sync_fetch_and_and(x, ~mask);
+#else
+  unsigned int old = *x;
+  *x &= ~mask;
+  return old;
+#endif
+}
+
+
+/* Atomically replace *x by new_value if it equals old_value. Return 1
+ * if successful.
+ */
+static int
+uct_compare_and_swap(unsigned int *x, unsigned int old_value,
+		     unsigned int new_value)
+{
+#if UCT_THREADS
+  return __sync_bool_compare_and_swap(x, old_value, new_value);
+#else
+  if (*x != old_value)
+    return 0;
+  *x = new_value;
+  return 1;
+#endif
+}
+
+
+/* Make sure that all memory writes before the barrier are seen by
+ * other threads before those after it, and likewise for reads.
+ */
+static void
+uct_memory_barrier(void)
+{
+#if UCT_THREADS
+  __sync_synchronize();
+#endif
+}
+
+
+/* Lock node, if there are multiple threads. */
+static void
+uct_lock_node(struct uct_tree *tree, struct uct_node *node)
+{
+#if UCT_THREADS
+  if (tree->num_threads > 1)
+    pthread_mutex_lock(&uct_node_locks[(node - tree->nodes)
+				       % UCT_NUM_NODE_LOCKS]);
+#else
+  UNUSED(tree);
+  UNUSED(node);
+#endif
+}
+
+
+static void
+uct_unlock_node(struct uct_tree *tree, struct uct_node *node)
+{
+#if UCT_THREADS
+  if (tree->num_threads > 1)
+    pthread_mutex_unlock(&uct_node_locks[(node - tree->nodes)
+					 % UCT_NUM_NODE_LOCKS]);
+#else
+  UNUSED(tree);
+  UNUSED(node);
+#endif
+}
+
+
+/* Add the result of a simulation to the score sums of node. */
+static void
+uct_update_scores(struct uct_tree *tree, struct uct_node *node, float result)
+{
+  uct_lock_node(tree, node);
+  node->sum_scores += result;
+  node->sum_scores2 += result * result;
+  uct_unlock_node(tree, node);
+}
+
+
+/* Return the number of children of node and set *children to point
+ * to the array of them. While other threads add children, the array
+ * returned stays valid for the returned number of children.
+ */
+static int
+uct_get_children(struct uct_node *node, struct uct_arc **children)
+{
+  int num_children = node->num_children;
+  uct_memory_barrier();
+  *children = node->children;
+  return num_children;
+}
+
+
+/* Add an arc for move to node as the last child of parent, growing
+ * the child array if it is full. Return 0 and mark the tree as full
+ * if the arc pool is exhausted.
+ *
+ * Untested moves are claimed by one thread only, but any number of
+ * threads may decide to pass at once. So a pass is looked up under
+ * the lock, and -1 is returned if another thread already added it.
+ */
+static int
+uct_add_child(struct uct_tree *tree, struct uct_node *parent, int move,
+	      struct uct_node *node)
+{
+  int n;
+
+  uct_lock_node(tree, parent);
+  n = parent->num_children;
+  if (move == PASS_MOVE) {
+    int k;
+    for (k = 0; k < n; k++)
+      if (parent->children[k].move == PASS_MOVE) {
+	uct_unlock_node(tree, parent);
+	return -1;
+      }
+  }
+  if (n == parent->max_children) {
+    int max_children = gg_max(2 * n, UCT_INITIAL_CHILDREN);
+    int index = uct_fetch_and_add(&tree->num_used_arcs, max_children);
+    struct uct_arc *children;
+    if (index + max_children > tree->num_arcs) {
+      tree->full = 1;
+      uct_unlock_node(tree, parent);
+      return 0;
+    }
+    children = &tree->arcs[index];
+    if (n > 0)
+      memcpy(children, parent->children, n * sizeof(*children));
+    parent->children = children;
+    parent->max_children = max_children;
+  }
+  parent->children[n].move = move;
+  parent->children[n].node = node;
+  uct_memory_barrier();
+  parent->num_children = n + 1;
+  uct_unlock_node(tree, parent);
+
+  return 1;
+}
+
 
 static struct uct_node *
-uct_init_node(struct uct_tree *tree, int *allowed_moves)
+uct_init_node(struct uct_tree *tree, struct mc_board *mc, int *allowed_moves)
 {
   int pos;
-  struct uct_node *node = &tree->nodes[tree->num_used_nodes++];
+  int index = uct_fetch_and_add(&tree->num_used_nodes, 1);
+  struct uct_node *node;
 
+  gg_assert(index < tree->num_nodes);
+  node = &tree->nodes[index];
   node->wins = 0;
   node->games = 0;
+  node->amaf_wins = 0;
+  node->amaf_games = 0;
   node->sum_scores = 0.0;
   node->sum_scores2 = 0.0;
-  node->child = NULL;
+  node->children = NULL;
+  node->num_children = 0;
+  node->max_children = 0;
   memset(node->untested.bits, 0, sizeof(node->untested.bits));
   for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
-    if (tree->game.mc.board[pos] == EMPTY
+    if (mc->board[pos] == EMPTY
 	&& !tree->forbidden_moves[pos]
 	&& (!allowed_moves || allowed_moves[pos])) {
       node->untested.bits[pos / 32] |= 1 << pos % 32;
     }
   }
-  node->boardhash = tree->game.mc.hash;
+  node->boardhash = mc->hash;
 
   return node;
 }
 
 static struct uct_node *
-uct_find_node(struct uct_tree *tree, struct uct_node *parent, int move)
+uct_find_node(struct uct_worker *worker, struct uct_node *parent, int move)
 {
+  struct uct_tree *tree = worker->tree;
   struct uct_node *node = NULL;
-  Hash_data *boardhash = &tree->game.mc.hash;
+  struct uct_node *new_node = NULL;
+  Hash_data *boardhash = &worker->game.mc.hash;
   unsigned int hash_index = hashdata_remainder(*boardhash,
 					       tree->hashtable_size);
   unsigned int *hashtable = tree->hashtable_even;
-  if (tree->game.depth & 1)
+  if (worker->game.depth & 1)
     hashtable = tree->hashtable_odd;
 
-  while (hashtable[hash_index] != 0) {
+  while (1) {
     int node_index = hashtable[hash_index];
+    if (node_index == 0) {
+      /* Not found. Try to claim this slot for a new node. If another
+       * thread gets there first we have to look at the slot again
+       * since it may have added the very same position. In that case
+       * the node we allocated is wasted.
+       */
+      if (!new_node)
+	new_node = uct_init_node(tree, &worker->game.mc, NULL);
+      if (uct_compare_and_swap(&hashtable[hash_index], 0,
+			       new_node - tree->nodes)) {
+	node = new_node;
+	break;
+      }
+      continue;
+    }
     gg_assert(node_index > 0 && node_index < tree->num_nodes);
     if (hashdata_is_equal(tree->nodes[node_index].boardhash, *boardhash)) {
       node = &tree->nodes[node_index];
@@ -1837,23 +2452,12 @@ uct_find_node(struct uct_tree *tree, struct uct_node *parent, int move)
       hash_index = 0;
   }
 
-  if (!node) {
-    node = uct_init_node(tree, NULL);
-    gg_assert(hash_index < tree->hashtable_size);
-    hashtable[hash_index] = node - tree->nodes;
-  }
-  
-  /* Add the node as the first of the siblings. */
   if (parent) {
-    struct uct_arc *arc = &tree->arcs[tree->num_used_arcs++];
-    gg_assert(tree->num_used_arcs < tree->num_arcs);
-    arc->move = move;
-    arc->node = node;
-    if (parent->child)
-      arc->next = parent->child;
-    else
-      arc->next = NULL;
-    parent->child = arc;
+    int added = uct_add_child(tree, parent, move, node);
+    if (added > 0)
+      worker->num_new_arcs++;
+    else if (added < 0)
+      worker->lost_race = 1;
   }
 
   return node;
@@ -1861,48 +2465,48 @@ uct_find_node(struct uct_tree *tree, struct uct_node *parent, int move)
 
 
 static void
-uct_update_move_ordering(struct uct_tree *tree, int move)
+uct_update_move_ordering(struct uct_worker *worker, int move)
 {
-  int score = ++tree->move_score[move];
+  int score = ++worker->move_score[move];
   while (1) {
-    int n = tree->inverse_move_ordering[move];
+    int n = worker->inverse_move_ordering[move];
     int preceding_move;
     if (n == 0)
       return;
-    preceding_move = tree->move_ordering[n - 1];
-    if (tree->move_score[preceding_move] >= score)
+    preceding_move = worker->move_ordering[n - 1];
+    if (worker->move_score[preceding_move] >= score)
       return;
 
     /* Swap move ordering. */
-    tree->move_ordering[n - 1] = move;
-    tree->move_ordering[n] = preceding_move;
-    tree->inverse_move_ordering[move] = n - 1;
-    tree->inverse_move_ordering[preceding_move] = n;
+    worker->move_ordering[n - 1] = move;
+    worker->move_ordering[n] = preceding_move;
+    worker->inverse_move_ordering[move] = n - 1;
+    worker->inverse_move_ordering[preceding_move] = n;
   }
 }
 
 
 static void
-uct_init_move_ordering(struct uct_tree *tree)
+uct_init_move_ordering(struct uct_worker *worker)
 {
   int pos;
   int k = 0;
   /* FIXME: Exclude forbidden moves. */
-  memset(tree->move_score, 0, sizeof(tree->move_score));
+  memset(worker->move_score, 0, sizeof(worker->move_score));
   for (pos = BOARDMIN; pos < BOARDMAX; pos++)
     if (ON_BOARD(pos)) {
-      tree->move_ordering[k] = pos;
-      tree->inverse_move_ordering[pos] = k;
+      worker->move_ordering[k] = pos;
+      worker->inverse_move_ordering[pos] = k;
       k++;
     }
   
-  tree->num_ordered_moves = k;
+  worker->num_ordered_moves = k;
 
   /* FIXME: Quick and dirty experiment. */
   for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
     if (ON_BOARD(pos)) {
-      tree->move_score[pos] = (int) (10 * potential_moves[pos]) - 1;
-      uct_update_move_ordering(tree, pos);
+      worker->move_score[pos] = (int) (10 * potential_moves[pos]) - 1;
+      uct_update_move_ordering(worker, pos);
     }
   }
 }
@@ -1914,30 +2518,170 @@ uct_finish_and_score_game(struct mc_game *game)
   return komi + mc_play_random_game(game);
 }
 
+/* Try the untested move pos from node. If no other thread has
+ * claimed it first, and it is legal and does not fill a proper small
+ * eye, play it and return the child node, setting *move.
+ */
 static struct uct_node *
-uct_play_move(struct uct_tree *tree, struct uct_node *node, float alpha,
-	      float *gamma, int *move)
+uct_try_untested_move(struct uct_worker *worker, struct uct_node *node,
+		      int pos, int *move)
 {
-  struct uct_arc *child_arc;
-  int pos;
-  struct uct_arc *next_arc = NULL;
-  struct uct_arc *best_winrate_arc = NULL;
-  float best_uct_value = 0.0;
-  float best_winrate = 0.0;
-  
-  for (child_arc = node->child; child_arc; child_arc = child_arc->next) {
-    struct uct_node *child_node = child_arc->node;
-    float winrate = (float) child_node->wins / child_node->games;
-    float uct_value;
-    float log_games_ratio = log(node->games) / child_node->games;
-    float x = winrate * (1.0 - winrate) + sqrt(2.0 * log_games_ratio);
-    if (x < 0.25)
-      x = 0.25;
-    uct_value = winrate + sqrt(2 * log_games_ratio * x / (1 + tree->game.depth));
-    if (uct_value > best_uct_value) {
-      next_arc = child_arc;
-      best_uct_value = uct_value;
-    }
+  struct mc_game *game = &worker->game;
+  struct mc_board *mc = &game->mc;
+  unsigned int mask = 1U << (pos % 32);
+  int proper_small_eye = 1;
+  int r;
+
+  /* Test and clear the untested bit in one go, so that no two
+   * threads try the same move.
+   */
+  if (!(uct_fetch_and_clear_bits(&node->untested.bits[pos / 32], mask)
+	& mask))
+    return NULL;
+
+  *move = pos;
+
+  for (r = 0; r < 4; r++) {
+    if (mc->board[pos + delta[r]] == EMPTY
+	|| mc->board[pos + delta[r]] == OTHER_COLOR(game->color_to_move)) {
+      proper_small_eye = 0;
+      break;
+    }
+  }
+	
+  if (proper_small_eye) {
+    int diagonal_value = 0;
+    for (r = 4; r < 8; r++) {
+      int pos2 = pos + delta[r];
+      if (!MC_ON_BOARD(pos2))
+	diagonal_value++;
+      else if (mc->board[pos2] == OTHER_COLOR(game->color_to_move))
+	diagonal_value += 2;
+    }
+    if (diagonal_value > 3)
+      proper_small_eye = 0;
+  }
+	
+  if (!proper_small_eye && mc_play_random_move(game, *move))
+    return uct_find_node(worker, node, *move);
+
+  return NULL;
+}
+
+
+/* Number of children a node with the given number of games may have
+ * with progressive widening. The second child is unlocked at
+ * mc_widening games and each further one after UCT_WIDENING_FACTOR
+ * times as many.
+ */
+static int
+uct_widening_limit(int games)
+{
+  if (games < mc_widening)
+    return 1;
+
+  return 2 + (int) (log((double) games / mc_widening)
+		    / log(UCT_WIDENING_FACTOR));
+}
+
+
+/* Find the untested move of node with the highest pattern value for
+ * the color to move, using the NEAR values for moves next to the last
+ * move like the playouts do. Ties are broken by the move ordering
+ * scores. Return NO_MOVE if there is none.
+ */
+static int
+uct_best_untested_move(struct uct_worker *worker, struct uct_node *node)
+{
+  struct mc_game *game = &worker->game;
+  struct mc_board *mc = &game->mc;
+  int color = game->color_to_move;
+  unsigned int *move_values = mc->move_values_black;
+  unsigned int values[BOARDMAX];
+  int best_move = NO_MOVE;
+  unsigned int best_value = 0;
+  int pos;
+
+  if (color == WHITE)
+    move_values = mc->move_values_white;
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    values[pos] = move_values[pos];
+
+  if (game->last_move != PASS_MOVE) {
+    for (pos = mc->queue[0]; pos != 1; pos = mc->queue[pos])
+      if (mc->board[pos] == EMPTY)
+	values[pos] = mc_patterns.values[mc_find_pattern_number(mc, pos,
+								color, 1)];
+  }
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    if (!(node->untested.bits[pos / 32] & (1U << pos % 32)))
+      continue;
+    if (best_move == NO_MOVE
+	|| values[pos] > best_value
+	|| (values[pos] == best_value
+	    && worker->move_score[pos] > worker->move_score[best_move])) {
+      best_move = pos;
+      best_value = values[pos];
+    }
+  }
+
+  return best_move;
+}
+
+
+static struct uct_node *
+uct_play_move(struct uct_worker *worker, struct uct_node *node, float alpha,
+	      float *gamma, int *move)
+{
+  struct mc_game *game = &worker->game;
+  struct uct_arc *children;
+  int num_children = uct_get_children(node, &children);
+  int pos;
+  int k;
+  struct uct_arc *next_arc = NULL;
+  struct uct_arc *best_winrate_arc = NULL;
+  float best_uct_value = 0.0;
+  float best_winrate = 0.0;
+  
+  for (k = num_children - 1; k >= 0; k--) {
+    struct uct_arc *child_arc = &children[k];
+    struct uct_node *child_node = child_arc->node;
+    int games = child_node->games;
+    float winrate;
+    float uct_value;
+    float log_games_ratio;
+    float x;
+
+    /* Just added by another thread, which has not yet entered it. */
+    if (games == 0)
+      continue;
+
+    winrate = (float) child_node->wins / games;
+    log_games_ratio = log(node->games) / games;
+    x = winrate * (1.0 - winrate) + sqrt(2.0 * log_games_ratio);
+    if (x < 0.25)
+      x = 0.25;
+    uct_value = sqrt(2 * log_games_ratio * x / (1 + game->depth));
+
+    /* Blend in the AMAF winrate, with a weight which falls off as the
+     * node gets more games of its own.
+     */
+    if (mc_rave_equivalence > 0 && child_node->amaf_games > 0) {
+      float amaf_winrate = ((float) child_node->amaf_wins
+			    / child_node->amaf_games);
+      float rave_beta = sqrt(mc_rave_equivalence
+			     / (3.0 * games + mc_rave_equivalence));
+      uct_value += (1.0 - rave_beta) * winrate + rave_beta * amaf_winrate;
+    }
+    else
+      uct_value += winrate;
+
+    if (uct_value > best_uct_value) {
+      next_arc = child_arc;
+      best_uct_value = uct_value;
+    }
 
     if (winrate > best_winrate) {
       best_winrate_arc = child_arc;
@@ -1948,115 +2692,771 @@ uct_play_move(struct uct_tree *tree, struct uct_node *node, float alpha,
   *gamma = best_winrate;
   if (best_winrate > alpha)
     next_arc = best_winrate_arc;
+  else if (mc_widening > 0) {
+    /* Progressive widening. Only add a child if the node has enough
+     * games for it, trying the moves in order of pattern value.
+     */
+    if (num_children < uct_widening_limit(node->games) || !next_arc) {
+      while ((pos = uct_best_untested_move(worker, node)) != NO_MOVE) {
+	struct uct_node *next_node = uct_try_untested_move(worker, node,
+							   pos, move);
+	if (next_node)
+	  return next_node;
+      }
+    }
+  }
   else {
     /* First play a random previously unplayed move, if any. */
-    int k;
-    for (k = -1; k < tree->num_ordered_moves; k++) {
+    for (k = -1; k < worker->num_ordered_moves; k++) {
+      struct uct_node *next_node;
       if (k == -1 && best_uct_value > 0.0)
 	continue;
       else if (k == -1)
-	pos = mc_generate_random_move(&tree->game);
+	pos = mc_generate_random_move(game);
       else
-	pos = tree->move_ordering[k];
-      
-      if (node->untested.bits[pos / 32] & (1 << (pos % 32))) {
-	int r;
-	int proper_small_eye = 1;
-	struct mc_board *mc = &tree->game.mc;
-	*move = pos;
-	node->untested.bits[*move / 32] &= ~(1 << *move % 32);
-
-	for (r = 0; r < 4; r++) {
-	  if (mc->board[pos + delta[r]] == EMPTY
-	      || mc->board[pos + delta[r]] == OTHER_COLOR(tree->game.color_to_move)) {
-	    proper_small_eye = 0;
-	    break;
-	  }
-	}
-	
-	if (proper_small_eye) {
-	  int diagonal_value = 0;
-	  for (r = 4; r < 8; r++) {
-	    int pos2 = pos + delta[r];
-	    if (!MC_ON_BOARD(pos2))
-	      diagonal_value++;
-	    else if (mc->board[pos2] == OTHER_COLOR(tree->game.color_to_move))
-	      diagonal_value += 2;
-	  }
-	  if (diagonal_value > 3)
-	    proper_small_eye = 0;
-	}
-	
-	if (!proper_small_eye && mc_play_random_move(&tree->game, *move))
-	  return uct_find_node(tree, node, *move);
-      }
+	pos = worker->move_ordering[k];
+
+      next_node = uct_try_untested_move(worker, node, pos, move);
+      if (next_node)
+	return next_node;
     }
   }
   
   if (!next_arc) {
-    mc_play_random_move(&tree->game, PASS_MOVE);
+    mc_play_random_move(game, PASS_MOVE);
     *move = PASS_MOVE;
-    return uct_find_node(tree, node, PASS_MOVE);
+    return uct_find_node(worker, node, PASS_MOVE);
   }
 
   *move = next_arc->move;
-  mc_play_random_move(&tree->game, next_arc->move);
+  mc_play_random_move(game, next_arc->move);
   
   return next_arc->node;
 }
 
+/* Set up worker->amaf_depth for the moves of a finished simulation,
+ * from depth and on.
+ */
+static void
+uct_init_amaf(struct uct_worker *worker, int depth)
+{
+  struct mc_game *game = &worker->game;
+  int last = gg_min(game->depth, (int) (sizeof(game->move_history)
+					/ sizeof(game->move_history[0])));
+  int k;
+
+  for (k = 0; k < BOARDMAX; k++)
+    worker->amaf_depth[k] = -1;
+  for (k = last - 1; k >= depth; k--)
+    worker->amaf_depth[game->move_history[k]] = k;
+}
+
+
+/* Update the AMAF statistics of the children of node, at the given
+ * depth, after a simulation which was a win for the color to move
+ * at the node if win is nonzero.
+ */
+static void
+uct_update_amaf(struct uct_worker *worker, struct uct_node *node,
+		int depth, int win)
+{
+  struct uct_arc *children;
+  int num_children = uct_get_children(node, &children);
+  int k;
+
+  for (k = 0; k < num_children; k++) {
+    struct uct_arc *child_arc = &children[k];
+    int first_depth = worker->amaf_depth[child_arc->move];
+    if (child_arc->move != PASS_MOVE
+	&& first_depth >= depth
+	&& (first_depth - depth) % 2 == 0) {
+      uct_fetch_and_add(&child_arc->node->amaf_games, 1);
+      if (win)
+	uct_fetch_and_add(&child_arc->node->amaf_wins, 1);
+    }
+  }
+}
+
+
 static float
-uct_traverse_tree(struct uct_tree *tree, struct uct_node *node,
+uct_traverse_tree(struct uct_worker *worker, struct uct_node *node,
 		  float alpha, float beta)
 {
-  int color = tree->game.color_to_move;
-  int num_passes = tree->game.consecutive_passes;
+  struct uct_tree *tree = worker->tree;
+  int color = worker->game.color_to_move;
+  int num_passes = worker->game.consecutive_passes;
+  int depth = worker->game.depth;
   float result;
   float gamma;
   int move = PASS_MOVE;
+  int previous_games;
+
+  /* Count the visit right away, as a virtual loss until the result
+   * is known.
+   */
+  previous_games = uct_fetch_and_add(&node->games, 1);
   
   /* FIXME: Unify these. */
-  if (num_passes == 3 || tree->game.depth >= UCT_MAX_SEARCH_DEPTH
-      || (node->games == 0 && node != tree->nodes))
-    result = uct_finish_and_score_game(&tree->game);
+  if (num_passes == 3 || worker->game.depth >= UCT_MAX_SEARCH_DEPTH
+      || (previous_games == 0 && node != tree->nodes)) {
+    result = uct_finish_and_score_game(&worker->game);
+    if (mc_rave_equivalence > 0)
+      uct_init_amaf(worker, depth);
+  }
   else {
     struct uct_node *next_node;
-    next_node = uct_play_move(tree, node, alpha, &gamma, &move);
+    next_node = uct_play_move(worker, node, alpha, &gamma, &move);
     
     gamma += 0.00;
     if (gamma > 0.8)
       gamma = 0.8;
-    result = uct_traverse_tree(tree, next_node, beta, gamma);
+    result = uct_traverse_tree(worker, next_node, beta, gamma);
   }
 
-  node->games++;
   if ((result > 0) ^ (color == WHITE)) {
-    node->wins++;
+    uct_fetch_and_add(&node->wins, 1);
     if (move != PASS_MOVE)
-      uct_update_move_ordering(tree, move);
+      uct_update_move_ordering(worker, move);
   }
 
-  node->sum_scores += result;
-  node->sum_scores2 += result * result;
+  /* The wins of a node count for the color which moved into it, so
+   * the children score the opposite way.
+   */
+  if (mc_rave_equivalence > 0 && depth < worker->game.depth) {
+    worker->amaf_depth[worker->game.move_history[depth]] = depth;
+    uct_update_amaf(worker, node, depth, !((result > 0) ^ (color == WHITE)));
+  }
+
+  uct_update_scores(tree, node, result);
   
   return result;
 }
 
+
+/* In a time limited search, decide whether the most visited move at
+ * the root can still be overtaken by another move in the remaining
+ * time, assuming the simulation rate stays the same. Return 1 if not.
+ */
+static int
+uct_search_is_decided(struct uct_tree *tree)
+{
+  struct uct_arc *children;
+  int num_children = uct_get_children(&tree->nodes[0], &children);
+  double now = gg_gettimeofday();
+  int games = tree->nodes[0].games - tree->start_games;
+  int most_games = 0;
+  int second_most_games = 0;
+  double remaining_games;
+  int k;
+
+  if (games < UCT_DECISION_CHECK_INTERVAL || now <= tree->start_time)
+    return 0;
+
+  remaining_games = games * (tree->deadline - now) / (now - tree->start_time);
+
+  /* Each simulation uses at least one node, unless it stops the
+   * search, and those are not recycled.
+   */
+  if (!tree->recycle
+      && remaining_games > tree->num_nodes - tree->num_used_nodes)
+    remaining_games = tree->num_nodes - tree->num_used_nodes;
+
+  for (k = 0; k < num_children; k++) {
+    int child_games = children[k].node->games;
+    if (child_games > most_games) {
+      second_most_games = most_games;
+      most_games = child_games;
+    }
+    else if (child_games > second_most_games)
+      second_most_games = child_games;
+  }
+
+  return most_games - second_most_games > remaining_games;
+}
+
+
+/* Run simulations until the tree is full, the position looks solved
+ * to this thread, the time or the games are used up, or another
+ * thread tells us to stop.
+ */
+static void
+uct_search(struct uct_worker *worker)
+{
+  struct uct_tree *tree = worker->tree;
+  int simulations = 0;
+
+  /* Each simulation adds at most one node per level of the tree. Stop
+   * while there is still room for the simulations in progress in all
+   * threads. Running out of arcs marks the tree as full by itself.
+   */
+  int margin = UCT_MAX_SEARCH_DEPTH * tree->num_threads;
+
+  while (!tree->stop && !tree->full) {
+    if (tree->num_used_nodes >= tree->num_nodes - margin) {
+      tree->full = 1;
+      break;
+    }
+    if (tree->max_games > 0
+	&& tree->nodes[0].games - tree->start_games >= tree->max_games) {
+      tree->stop = 1;
+      break;
+    }
+
+    worker->game = tree->starting_position;
+    if (tree->num_threads > 1)
+      worker->game.rand_state = &worker->rand_state;
+    worker->game.ladder_cache = &worker->ladder_cache;
+    worker->num_new_arcs = 0;
+    worker->lost_race = 0;
+    uct_traverse_tree(worker, &tree->nodes[0], 1.0, 0.9);
+    /* FIXME: Ugly workaround for solved positions before running out
+     * of nodes. Only this thread gives up, and not if the simulation
+     * added nothing just because another thread got there first.
+     */
+    if (worker->num_new_arcs == 0 && !worker->lost_race)
+      break;
+
+    if (tree->deadline > 0.0) {
+      simulations++;
+      if (gg_gettimeofday() >= tree->deadline
+	  || (simulations % UCT_DECISION_CHECK_INTERVAL == 0
+	      && !tree->analyzing
+	      && uct_search_is_decided(tree)))
+	tree->stop = 1;
+    }
+  }
+}
+
+
+#if UCT_THREADS
+static void *
+uct_search_thread(void *data)
+{
+  struct uct_worker *worker = (struct uct_worker *) data;
+  restore_board(&worker->tree->board_state);
+  uct_search(worker);
+  free_board_state();
+  return NULL;
+}
+#endif
+
+
+static int uct_recycle_nodes(struct uct_tree *tree);
+
+/* Run the UCT search with mc_threads threads, including the calling
+ * one. If time_limit is positive, stop after that many seconds, or
+ * earlier if the outcome is clear. The caller must clear tree->stop
+ * before the call.
+ *
+ * If the tree is memory bounded, nodes are recycled whenever it
+ * fills up, with all threads stopped, and the search goes on.
+ */
+static void
+uct_run_search(struct uct_tree *tree, double time_limit)
+{
+  struct uct_worker *workers;
+  int k;
+
+  tree->start_time = gg_gettimeofday();
+  tree->start_games = tree->nodes[0].games;
+  if (time_limit > 0.0)
+    tree->deadline = tree->start_time + time_limit;
+  else
+    tree->deadline = 0.0;
+
+  tree->num_threads = gg_max(mc_threads, 1);
+#if !UCT_THREADS
+  tree->num_threads = 1;
+#endif
+
+  workers = malloc(tree->num_threads * sizeof(*workers));
+  gg_assert(workers);
+  for (k = 0; k < tree->num_threads; k++) {
+    workers[k].tree = tree;
+    if (tree->num_threads > 1)
+      gg_srand_r(&workers[k].rand_state, gg_urand());
+    memset(workers[k].ladder_cache.results, 0,
+	   sizeof(workers[k].ladder_cache.results));
+    uct_init_move_ordering(&workers[k]);
+  }
+
+  while (1) {
+    tree->full = 0;
+#if UCT_THREADS
+    if (tree->num_threads > 1) {
+      pthread_t *threads = malloc(tree->num_threads * sizeof(*threads));
+      static int locks_initialized = 0;
+      gg_assert(threads);
+      if (!locks_initialized) {
+	for (k = 0; k < UCT_NUM_NODE_LOCKS; k++)
+	  pthread_mutex_init(&uct_node_locks[k], NULL);
+	locks_initialized = 1;
+      }
+
+      for (k = 1; k < tree->num_threads; k++)
+	if (pthread_create(&threads[k], NULL, uct_search_thread,
+			   &workers[k]) != 0) {
+	  /* Continue with the threads we got. */
+	  tree->num_threads = k;
+	  break;
+	}
+
+      uct_search(&workers[0]);
+
+      for (k = 1; k < tree->num_threads; k++)
+	pthread_join(threads[k], NULL);
+      free(threads);
+    }
+    else
+#endif
+      uct_search(&workers[0]);
+
+    /* If the tree is not full, all threads found the position
+     * solved or were told to stop.
+     */
+    if (tree->stop || !tree->full || !tree->recycle
+	|| !uct_recycle_nodes(tree))
+      break;
+  }
+
+  free(workers);
+}
+
+/* Insert the node with the given index into hashtable. */
+static void
+uct_hashtable_insert(struct uct_tree *tree, unsigned int *hashtable,
+		     int node_index)
+{
+  unsigned int hash_index = hashdata_remainder(tree->nodes[node_index].boardhash,
+					       tree->hashtable_size);
+  while (hashtable[hash_index] != 0) {
+    hash_index++;
+    if (hash_index >= tree->hashtable_size)
+      hash_index = 0;
+  }
+  hashtable[hash_index] = node_index;
+}
+
+
+/* Discard all nodes and arcs which cannot be reached from the node
+ * with index root_index, or only through nodes with fewer than
+ * min_games games, and compact the remaining ones at the start of
+ * the pools, with the new root at index 0. If root_parity is odd the
+ * new root was found in the odd hash table and the two tables swap
+ * roles. The moves to discarded children become untested again.
+ *
+ * The compaction preserves the relative order of the surviving nodes
+ * so that they can be moved in place. The child arrays are copied to
+ * a new arc pool, without room to spare. The new root is swapped into
+ * position 0 afterwards. The root is not stored in the hash tables
+ * and those are rebuilt from scratch.
+ */
+static void
+uct_collect_garbage(struct uct_tree *tree, int root_index, int root_parity,
+		    int min_games)
+{
+  int num_nodes = tree->num_used_nodes;
+  int *node_map = malloc(num_nodes * sizeof(*node_map));
+  int *stack = malloc(num_nodes * sizeof(*stack));
+  unsigned char *parity = calloc(num_nodes, sizeof(*parity));
+  struct uct_arc *arcs = malloc(tree->num_arcs * sizeof(*arcs));
+  int stack_size = 0;
+  int new_root;
+  int n;
+  int k;
+  int m;
+
+  gg_assert(node_map && stack && parity && arcs);
+
+  /* Mark the reachable nodes, with node_map[] as visited flag. The
+   * tree may contain cycles through transpositions.
+   */
+  for (k = 0; k < num_nodes; k++)
+    node_map[k] = -1;
+  node_map[root_index] = 0;
+  stack[stack_size++] = root_index;
+  while (stack_size > 0) {
+    struct uct_node *node = &tree->nodes[stack[--stack_size]];
+    for (m = 0; m < node->num_children; m++) {
+      int child_index = node->children[m].node - tree->nodes;
+      if (node_map[child_index] < 0
+	  && tree->nodes[child_index].games >= min_games) {
+	node_map[child_index] = 0;
+	stack[stack_size++] = child_index;
+      }
+    }
+  }
+
+  /* Remember which hash table each surviving node belongs to. */
+  for (k = 0; k < (int) tree->hashtable_size; k++) {
+    int index = tree->hashtable_odd[k];
+    if (index != 0 && node_map[index] == 0)
+      parity[index] = 1;
+  }
+
+  /* Compute the new indices. */
+  n = 0;
+  for (k = 0; k < num_nodes; k++)
+    if (node_map[k] == 0)
+      node_map[k] = n++;
+  tree->num_used_nodes = n;
+
+  /* Copy the child arrays, then move the nodes. Since new indices
+   * never exceed the old ones, the latter can be done in a single
+   * pass in increasing order.
+   */
+  n = 0;
+  for (k = 0; k < num_nodes; k++) {
+    struct uct_node *node = &tree->nodes[k];
+    struct uct_arc *children = &arcs[n];
+    if (node_map[k] < 0)
+      continue;
+    for (m = 0; m < node->num_children; m++) {
+      int move = node->children[m].move;
+      int child_index = node->children[m].node - tree->nodes;
+      if (node_map[child_index] >= 0) {
+	arcs[n].move = move;
+	arcs[n].node = &tree->nodes[node_map[child_index]];
+	n++;
+      }
+      else if (move != PASS_MOVE)
+	node->untested.bits[move / 32] |= 1U << move % 32;
+    }
+    node->num_children = &arcs[n] - children;
+    node->max_children = node->num_children;
+    node->children = node->num_children > 0 ? children : NULL;
+  }
+  free(tree->arcs);
+  tree->arcs = arcs;
+  tree->num_used_arcs = n;
+
+  for (k = 0; k < num_nodes; k++)
+    if (node_map[k] >= 0)
+      tree->nodes[node_map[k]] = tree->nodes[k];
+
+  /* Swap the root into position 0. */
+  new_root = node_map[root_index];
+  if (new_root != 0) {
+    struct uct_node tmp = tree->nodes[0];
+    tree->nodes[0] = tree->nodes[new_root];
+    tree->nodes[new_root] = tmp;
+    for (k = 0; k < tree->num_used_arcs; k++) {
+      if (tree->arcs[k].node == &tree->nodes[0])
+	tree->arcs[k].node = &tree->nodes[new_root];
+      else if (tree->arcs[k].node == &tree->nodes[new_root])
+	tree->arcs[k].node = &tree->nodes[0];
+    }
+    for (k = 0; k < num_nodes; k++)
+      if (node_map[k] == 0)
+	node_map[k] = new_root;
+    node_map[root_index] = 0;
+  }
+
+  /* Rebuild the hash tables. */
+  memset(tree->hashtable_odd, 0,
+	 tree->hashtable_size * sizeof(*tree->hashtable_odd));
+  memset(tree->hashtable_even, 0,
+	 tree->hashtable_size * sizeof(*tree->hashtable_even));
+  for (k = 0; k < num_nodes; k++) {
+    if (node_map[k] > 0) {
+      if (parity[k] ^ root_parity)
+	uct_hashtable_insert(tree, tree->hashtable_odd, node_map[k]);
+      else
+	uct_hashtable_insert(tree, tree->hashtable_even, node_map[k]);
+    }
+  }
+
+  free(node_map);
+  free(stack);
+  free(parity);
+}
+
+
+/* Make room in a full tree by discarding the nodes with the fewest
+ * games, keeping at most UCT_RECYCLE_FRACTION of the pool. Return 0
+ * if that does not free enough nodes to go on.
+ */
+static int
+uct_recycle_nodes(struct uct_tree *tree)
+{
+  int *histogram = calloc(UCT_RECYCLE_MAX_GAMES + 1, sizeof(*histogram));
+  int max_kept = UCT_RECYCLE_FRACTION * tree->num_nodes;
+  int margin = UCT_MAX_SEARCH_DEPTH * tree->num_threads;
+  int kept;
+  int min_games;
+  int k;
+
+  gg_assert(histogram);
+  for (k = 1; k < tree->num_used_nodes; k++)
+    histogram[gg_min(tree->nodes[k].games, UCT_RECYCLE_MAX_GAMES)]++;
+
+  kept = 0;
+  for (min_games = UCT_RECYCLE_MAX_GAMES; min_games > 0; min_games--) {
+    if (kept + histogram[min_games] > max_kept)
+      break;
+    kept += histogram[min_games];
+  }
+  free(histogram);
+
+  uct_collect_garbage(tree, 0, 0, min_games + 1);
+
+  if (mc_debug)
+    gprintf("Recycled the tree, keeping %d nodes with at least %d games.\n",
+	    tree->num_used_nodes, min_games + 1);
+
+  return (tree->num_used_nodes < tree->num_nodes - 2 * margin
+	  && tree->num_used_arcs < tree->num_arcs - 2 * margin);
+}
+
+
+/* Look for the starting position among the nodes of the tree kept
+ * from the previous search. Return the node index and set *parity to
+ * the hash table it was found in, or return -1 if it is not there.
+ */
+static int
+uct_find_root(struct uct_tree *tree, struct mc_game *starting_position,
+	      int *parity)
+{
+  Hash_data *boardhash = &starting_position->mc.hash;
+  unsigned int *hashtable;
+  unsigned int hash_index;
+
+  if (tree->num_used_nodes == 0)
+    return -1;
+
+  *parity = (starting_position->color_to_move != tree->root_color);
+  if (!*parity && hashdata_is_equal(tree->nodes[0].boardhash, *boardhash))
+    return 0;
+
+  hashtable = *parity ? tree->hashtable_odd : tree->hashtable_even;
+  hash_index = hashdata_remainder(*boardhash, tree->hashtable_size);
+  while (hashtable[hash_index] != 0) {
+    int node_index = hashtable[hash_index];
+    if (hashdata_is_equal(tree->nodes[node_index].boardhash, *boardhash))
+      return node_index;
+    hash_index++;
+    if (hash_index >= tree->hashtable_size)
+      hash_index = 0;
+  }
+
+  return -1;
+}
+
+
+/* Set up the tree for a search from starting_position. If the
+ * position is found in the tree from the previous search, typically
+ * two moves down, that subtree is kept as the new tree and all other
+ * nodes are reclaimed. Otherwise the tree is cleared.
+ */
+static void
+uct_prepare_tree(struct uct_tree *tree, struct mc_game *starting_position,
+		 int nodes, int *forbidden_moves, int *allowed_moves)
+{
+  int root_index = -1;
+  int parity = 0;
+
+  if (tree->nodes && tree->num_nodes != nodes) {
+    free(tree->nodes);
+    free(tree->arcs);
+    free(tree->hashtable_odd);
+    free(tree->hashtable_even);
+    tree->nodes = NULL;
+  }
+
+  if (!tree->nodes) {
+    tree->nodes = malloc(nodes * sizeof(*tree->nodes));
+    gg_assert(tree->nodes);
+    tree->arcs = malloc(UCT_ARCS_PER_NODE * nodes * sizeof(*tree->arcs));
+    gg_assert(tree->arcs);
+    tree->hashtable_size = nodes;
+    tree->hashtable_odd = calloc(tree->hashtable_size,
+				 sizeof(*tree->hashtable_odd));
+    tree->hashtable_even = calloc(tree->hashtable_size,
+				  sizeof(*tree->hashtable_even));
+    gg_assert(tree->hashtable_odd);
+    gg_assert(tree->hashtable_even);
+    tree->num_nodes = nodes;
+    tree->num_arcs = UCT_ARCS_PER_NODE * nodes;
+    tree->num_used_nodes = 0;
+    tree->num_used_arcs = 0;
+  }
+  else if (tree->komi == komi && tree->board_size == board_size)
+    root_index = uct_find_root(tree, starting_position, &parity);
+
+  tree->starting_position = *starting_position;
+  if (forbidden_moves != tree->forbidden_moves)
+    memcpy(tree->forbidden_moves, forbidden_moves,
+	   sizeof(tree->forbidden_moves));
+  tree->root_color = starting_position->color_to_move;
+  tree->komi = komi;
+  tree->board_size = board_size;
+#if UCT_THREADS
+  store_board(&tree->board_state);
+#endif
+
+  if (root_index >= 0) {
+    struct uct_node *root;
+    int pos;
+    int k;
+    int n;
+
+    uct_collect_garbage(tree, root_index, parity, 0);
+    root = &tree->nodes[0];
+
+    /* Drop moves which are no longer allowed at the root and prune
+     * the untested moves in the same way as a new root would be
+     * initialized.
+     */
+    n = 0;
+    for (k = 0; k < root->num_children; k++) {
+      int move = root->children[k].move;
+      if (move == PASS_MOVE
+	  || (!forbidden_moves[move]
+	      && (!allowed_moves || allowed_moves[move])))
+	root->children[n++] = root->children[k];
+    }
+    root->num_children = n;
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      if (starting_position->mc.board[pos] != EMPTY
+	  || forbidden_moves[pos]
+	  || (allowed_moves && !allowed_moves[pos]))
+	root->untested.bits[pos / 32] &= ~(1U << pos % 32);
+
+    if (mc_debug)
+      gprintf("Reusing %d nodes and %d games from the previous search.\n",
+	      tree->num_used_nodes, root->games);
+  }
+  else {
+    tree->num_used_nodes = 0;
+    tree->num_used_arcs = 0;
+    memset(tree->hashtable_odd, 0,
+	   tree->hashtable_size * sizeof(*tree->hashtable_odd));
+    memset(tree->hashtable_even, 0,
+	   tree->hashtable_size * sizeof(*tree->hashtable_even));
+    uct_init_node(tree, &starting_position->mc, allowed_moves);
+  }
+}
+
+
+/* Set up the mc_game for a search from the current position of the
+ * global board, with color to move.
+ */
+static void
+uct_init_starting_position(struct mc_game *starting_position, int color,
+			   int *forbidden_moves)
+{
+  int pos;
+
+  mc_init_board_from_global_board(&starting_position->mc);
+  mc_init_move_values(&starting_position->mc);
+  starting_position->color_to_move = color;
+  /* FIXME: Fill in correct information. */
+  starting_position->consecutive_passes = 0;
+  starting_position->consecutive_ko_captures = 0;
+  starting_position->last_move = get_last_move();
+  starting_position->depth = 0;
+  starting_position->rand_state = NULL;
+  starting_position->ladder_cache = NULL;
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    starting_position->settled[pos] = forbidden_moves[pos];
+}
+
+
+/* Pondering. While the opponent is thinking, a background thread
+ * keeps extending the search tree from the current position. When
+ * the opponent's move arrives, uct_genmove() picks up the subtree
+ * below it like any other reused part of the tree.
+ */
+#if UCT_THREADS
+static pthread_t uct_ponder_thread;
+#endif
+static int uct_pondering = 0;
+
+#if UCT_THREADS
+static void *
+uct_ponder_search(void *data)
+{
+  struct uct_tree *tree = (struct uct_tree *) data;
+  restore_board(&tree->board_state);
+  uct_run_search(tree, 0.0);
+  free_board_state();
+  return NULL;
+}
+#endif
+
+/* Start pondering with color to move in the current position. This
+ * is only done if the tree from the previous search is available,
+ * and the nodes it already has are reused with the moves forbidden
+ * then.
+ */
+void
+uct_ponder_start(int color)
+{
+#if UCT_THREADS
+  struct uct_tree *tree = &uct_persistent_tree;
+  struct mc_game starting_position;
+
+  if (uct_pondering
+      || !tree->nodes
+      || tree->board_size != board_size
+      || tree->komi != komi)
+    return;
+
+  uct_init_starting_position(&starting_position, color,
+			     tree->forbidden_moves);
+  uct_prepare_tree(tree, &starting_position, tree->num_nodes,
+		   tree->forbidden_moves, NULL);
+
+  tree->max_games = 0;
+  tree->analyzing = 0;
+  tree->stop = 0;
+  if (pthread_create(&uct_ponder_thread, NULL, uct_ponder_search, tree) == 0)
+    uct_pondering = 1;
+#else
+  UNUSED(color);
+#endif
+}
+
+/* Stop pondering, if it is going on, and wait for the search to
+ * finish.
+ */
+void
+uct_ponder_stop(void)
+{
+#if UCT_THREADS
+  struct uct_tree *tree = &uct_persistent_tree;
+
+  if (!uct_pondering)
+    return;
+
+  tree->stop = 1;
+  pthread_join(uct_ponder_thread, NULL);
+  uct_pondering = 0;
+
+  if (mc_debug)
+    gprintf("Pondered %d games in %f seconds.\n",
+	    tree->nodes[0].games - tree->start_games,
+	    gg_gettimeofday() - tree->start_time);
+#endif
+}
+
+
 static int
 uct_find_best_children(struct uct_node *node, struct uct_arc **children,
 		       int n)
 {
-  struct uct_arc *child_arc;
   float best_score;
   struct uct_arc *best_child;
   int found_moves[BOARDMAX];
   int k;
+  int m;
 
   memset(found_moves, 0, sizeof(found_moves));
   for (k = 0; k < n; k++) {
     best_score = 0.0;
     best_child = NULL;
-    for (child_arc = node->child; child_arc; child_arc = child_arc->next) {
+    for (m = node->num_children - 1; m >= 0; m--) {
+      struct uct_arc *child_arc = &node->children[m];
       struct uct_node *child_node = child_arc->node;
       if (!found_moves[child_arc->move]
 	  && best_score * child_node->games < child_node->wins) {
@@ -2077,11 +3477,12 @@ static void
 uct_dump_tree_recursive(struct uct_node *node, SGFTree *sgf_tree, int color,
 			int cutoff, int depth)
 {
-  struct uct_arc *child_arc;
   char buf[100];
+  int k;
   if (depth > 50)
     return;
-  for (child_arc = node->child; child_arc; child_arc = child_arc->next) {
+  for (k = node->num_children - 1; k >= 0; k--) {
+    struct uct_arc *child_arc = &node->children[k];
     struct uct_node *child_node = child_arc->node;
     sgftreeAddPlayLast(sgf_tree, color,
 		       I(child_arc->move), J(child_arc->move));
@@ -2111,68 +3512,386 @@ uct_dump_tree(struct uct_tree *tree, const char *filename, int color,
 }
 
 
+/* Write the search tree from the last search to filename in the binary
+ * format of uctdump.h, with the nodes in breadth first order from the
+ * root. Return 1 on success and 0 if there is no tree or the file
+ * cannot be written.
+ */
+int
+uct_dump_search_tree(const char *filename)
+{
+  struct uct_tree *tree = &uct_persistent_tree;
+  struct uct_dump_header *header;
+  struct uct_dump_node *dump_nodes;
+  struct uct_dump_arc *dump_arcs;
+  int *dump_index;
+  int *order;
+  int num_nodes;
+  int num_arcs;
+  char *buffer;
+  size_t size;
+  FILE *outfile;
+  int success;
+  int k;
+  int m;
+
+  if (!tree->nodes || tree->num_used_nodes == 0)
+    return 0;
+
+  /* Number the nodes reachable from the root. */
+  dump_index = malloc(tree->num_nodes * sizeof(*dump_index));
+  order = malloc(tree->num_nodes * sizeof(*order));
+  gg_assert(dump_index && order);
+  for (k = 0; k < tree->num_nodes; k++)
+    dump_index[k] = -1;
+  dump_index[0] = 0;
+  order[0] = 0;
+  num_nodes = 1;
+  num_arcs = 0;
+  for (k = 0; k < num_nodes; k++) {
+    struct uct_node *node = &tree->nodes[order[k]];
+    for (m = 0; m < node->num_children; m++) {
+      int child = node->children[m].node - tree->nodes;
+      if (dump_index[child] < 0) {
+	dump_index[child] = num_nodes;
+	order[num_nodes++] = child;
+      }
+    }
+    num_arcs += node->num_children;
+  }
+
+  /* Fill in the whole file in one buffer. */
+  size = (sizeof(*header) + num_nodes * sizeof(*dump_nodes)
+	  + num_arcs * sizeof(*dump_arcs));
+  buffer = calloc(size, 1);
+  gg_assert(buffer);
+  header = (struct uct_dump_header *) buffer;
+  dump_nodes = (struct uct_dump_node *) (header + 1);
+  dump_arcs = (struct uct_dump_arc *) (dump_nodes + num_nodes);
+
+  memcpy(header->magic, UCT_DUMP_MAGIC, sizeof(header->magic));
+  header->version = UCT_DUMP_VERSION;
+  header->max_board = MAX_BOARD;
+  header->board_size = tree->board_size;
+  header->root_color = tree->root_color;
+  header->komi = tree->komi;
+  header->num_nodes = num_nodes;
+  header->num_arcs = num_arcs;
+
+  num_arcs = 0;
+  for (k = 0; k < num_nodes; k++) {
+    struct uct_node *node = &tree->nodes[order[k]];
+    struct uct_dump_node *dump_node = &dump_nodes[k];
+    int bits = CHAR_BIT * SIZEOF_HASHVALUE;
+
+    for (m = 0; m < 2; m++)
+      if ((32 * m) / bits < NUM_HASHVALUES)
+	dump_node->hash[m] = (unsigned int)
+	  (node->boardhash.hashval[(32 * m) / bits] >> ((32 * m) % bits));
+    dump_node->wins = node->wins;
+    dump_node->games = node->games;
+    dump_node->amaf_wins = node->amaf_wins;
+    dump_node->amaf_games = node->amaf_games;
+    dump_node->sum_scores = node->sum_scores;
+    dump_node->sum_scores2 = node->sum_scores2;
+    dump_node->first_arc = num_arcs;
+    dump_node->num_arcs = node->num_children;
+    for (m = 0; m < node->num_children; m++) {
+      dump_arcs[num_arcs].move = node->children[m].move;
+      dump_arcs[num_arcs].node = dump_index[node->children[m].node
+					    - tree->nodes];
+      num_arcs++;
+    }
+  }
+
+  outfile = fopen(filename, "wb");
+  success = (outfile != NULL
+	     && fwrite(buffer, size, 1, outfile) == 1);
+  if (outfile && fclose(outfile) != 0)
+    success = 0;
+
+  free(buffer);
+  free(order);
+  free(dump_index);
+
+  return success;
+}
+
+
+/* Number of nodes which fit in a tree of the given size in megabytes,
+ * counting the arcs and hash table entries that go with them.
+ */
+static int
+uct_nodes_for_memory(float megabytes)
+{
+  size_t node_size = (sizeof(struct uct_node)
+		      + UCT_ARCS_PER_NODE * sizeof(struct uct_arc)
+		      + 2 * sizeof(unsigned int));
+  double nodes = megabytes * 1024.0 * 1024.0 / node_size;
+  int min_nodes = 16 * UCT_MAX_SEARCH_DEPTH * gg_max(mc_threads, 1);
+
+  if (nodes < min_nodes)
+    return min_nodes;
+  if (nodes > INT_MAX / UCT_ARCS_PER_NODE)
+    return INT_MAX / UCT_ARCS_PER_NODE;
+  return (int) nodes;
+}
+
+
+/* Analysis. Like pondering, a background thread extends the search
+ * tree from the current position until told to stop, but every
+ * interval seconds it pauses to call a report function, which can
+ * look at the root moves with uct_get_analysis().
+ */
+
+/* Memory in megabytes for the analysis tree if mc_memory is not set. */
+#define UCT_ANALYSIS_MEMORY 64.0
+
+#if UCT_THREADS
+static pthread_t uct_analysis_thread;
+#endif
+static int uct_analyzing = 0;
+static volatile int uct_analysis_stop = 0;
+static double uct_analysis_interval;
+static void (*uct_analysis_report)(void);
+
+#if UCT_THREADS
+static void *
+uct_analysis_search(void *data)
+{
+  struct uct_tree *tree = (struct uct_tree *) data;
+
+  restore_board(&tree->board_state);
+  uct_analysis_report();
+  while (1) {
+    /* uct_analyze_stop() sets uct_analysis_stop before tree->stop, so
+     * a stop request is never lost by clearing tree->stop here.
+     */
+    tree->stop = 0;
+    uct_memory_barrier();
+    if (uct_analysis_stop)
+      break;
+
+    uct_run_search(tree, uct_analysis_interval);
+    if (uct_analysis_stop)
+      break;
+    uct_analysis_report();
+
+    /* The search stopped before the end of the time slice, so the
+     * position is solved and there is nothing more to add.
+     */
+    if (gg_gettimeofday() < tree->deadline)
+      break;
+  }
+
+  free_board_state();
+  return NULL;
+}
+#endif
+
+/* Start analyzing the current position with color to move, calling
+ * report from the analysis thread right away and then every interval
+ * seconds. The tree from the previous search is reused if possible.
+ * Return 0 if the analysis could not be started.
+ */
+int
+uct_analyze_start(int color, double interval, void (*report)(void))
+{
+#if UCT_THREADS
+  struct uct_tree *tree = &uct_persistent_tree;
+  struct mc_game starting_position;
+  int forbidden_moves[BOARDMAX];
+  float megabytes = (mc_memory > 0.0 ? mc_memory : UCT_ANALYSIS_MEMORY);
+
+  uct_ponder_stop();
+  uct_analyze_stop();
+
+  memset(forbidden_moves, 0, sizeof(forbidden_moves));
+  uct_init_starting_position(&starting_position, color, forbidden_moves);
+  uct_prepare_tree(tree, &starting_position, uct_nodes_for_memory(megabytes),
+		   forbidden_moves, NULL);
+  tree->recycle = 1;
+  tree->max_games = 0;
+  tree->analyzing = 1;
+
+  uct_analysis_stop = 0;
+  uct_analysis_interval = interval;
+  uct_analysis_report = report;
+  if (pthread_create(&uct_analysis_thread, NULL, uct_analysis_search,
+		     tree) != 0) {
+    tree->analyzing = 0;
+    return 0;
+  }
+
+  uct_analyzing = 1;
+  return 1;
+#else
+  UNUSED(color);
+  UNUSED(interval);
+  UNUSED(report);
+  return 0;
+#endif
+}
+
+/* Stop the analysis, if it is going on, and wait for the analysis
+ * thread to finish.
+ */
+void
+uct_analyze_stop(void)
+{
+#if UCT_THREADS
+  struct uct_tree *tree = &uct_persistent_tree;
+
+  if (!uct_analyzing)
+    return;
+
+  uct_analysis_stop = 1;
+  uct_memory_barrier();
+  tree->stop = 1;
+  pthread_join(uct_analysis_thread, NULL);
+  uct_analyzing = 0;
+  tree->analyzing = 0;
+#endif
+}
+
+
+/* The child of node with the most games, or NULL if it has none. */
+static struct uct_arc *
+uct_most_visited_child(struct uct_node *node)
+{
+  struct uct_arc *best_arc = NULL;
+  int k;
+
+  for (k = node->num_children - 1; k >= 0; k--)
+    if (node->children[k].node->games > 0
+	&& (!best_arc
+	    || node->children[k].node->games > best_arc->node->games))
+      best_arc = &node->children[k];
+
+  return best_arc;
+}
+
+/* Fill in moves with up to max_moves of the root moves which have
+ * been visited, in order of decreasing number of games. Return the
+ * number of moves. This must only be called from the report function
+ * of uct_analyze_start(), while the search is paused.
+ */
+int
+uct_get_analysis(struct mc_analysis_move *moves, int max_moves)
+{
+  struct uct_tree *tree = &uct_persistent_tree;
+  struct uct_node *root = &tree->nodes[0];
+  int num_moves = 0;
+  int k;
+  int m;
+
+  for (k = root->num_children - 1; k >= 0; k--) {
+    struct uct_arc *arc = &root->children[k];
+    struct uct_node *node = arc->node;
+    struct mc_analysis_move *analysis;
+    double mean;
+    double variance;
+
+    if (node->games <= 0)
+      continue;
+
+    /* Insertion sort by the number of games. */
+    for (m = num_moves; m > 0 && moves[m - 1].games < node->games; m--)
+      if (m < max_moves)
+	moves[m] = moves[m - 1];
+    if (m >= max_moves)
+      continue;
+    if (num_moves < max_moves)
+      num_moves++;
+
+    /* The scores are counted for white. */
+    mean = node->sum_scores / node->games;
+    variance = 0.0;
+    if (node->games > 1)
+      variance = ((node->sum_scores2 - node->sum_scores * mean)
+		  / (node->games - 1));
+
+    analysis = &moves[m];
+    analysis->move = arc->move;
+    analysis->games = node->games;
+    analysis->winrate = (float) node->wins / node->games;
+    analysis->score_mean = (tree->root_color == WHITE ? mean : -mean);
+    analysis->score_stddev = sqrt(gg_max(variance, 0.0));
+    analysis->pv[0] = arc->move;
+    analysis->pv_length = 1;
+    while (analysis->pv_length < MC_ANALYSIS_PV_LENGTH) {
+      arc = uct_most_visited_child(node);
+      if (!arc)
+	break;
+      analysis->pv[analysis->pv_length++] = arc->move;
+      node = arc->node;
+    }
+  }
+
+  return num_moves;
+}
+
+
+/* Generate a move for color with a UCT search of the given number of
+ * games, or for time_limit seconds if that is positive. Without a
+ * memory budget (mc_memory), the tree has room for one node per game
+ * and the search stops if it fills up. With a budget, the tree is
+ * sized from it and recycled when full.
+ */
 void
 uct_genmove(int color, int *move, int *forbidden_moves, int *allowed_moves,
-	    int nodes, float *move_values, int *move_frequencies)
+	    int games, double time_limit, float *move_values,
+	    int *move_frequencies)
 {
-  struct uct_tree tree;
+  struct uct_tree *tree = &uct_persistent_tree;
   float best_score;
   struct uct_arc *arc;
   struct uct_node *node;
+  struct uct_node *root;
+  int k;
   struct mc_game starting_position;
   int most_games;
   struct uct_node *most_games_node;
   struct uct_arc *most_games_arc;
-  int pos;
 
-  mc_init_board_from_global_board(&starting_position.mc);
-  mc_init_move_values(&starting_position.mc);
-  starting_position.color_to_move = color;
-  /* FIXME: Fill in correct information. */
-  starting_position.consecutive_passes = 0;
-  starting_position.consecutive_ko_captures = 0;
-  starting_position.last_move = get_last_move();
-  starting_position.depth = 0;
-  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
-    starting_position.settled[pos] = forbidden_moves[pos];
-
-  tree.game = starting_position;
-  /* FIXME: Don't reallocate between moves. */
-  tree.nodes = malloc(nodes * sizeof(*tree.nodes));
-  gg_assert(tree.nodes);
-  tree.arcs = malloc(nodes * sizeof(*tree.arcs));
-  gg_assert(tree.arcs);
-  tree.hashtable_size = nodes;
-  tree.hashtable_odd = calloc(tree.hashtable_size,
-			      sizeof(*tree.hashtable_odd));
-  tree.hashtable_even = calloc(tree.hashtable_size,
-			       sizeof(*tree.hashtable_even));
-  gg_assert(tree.hashtable_odd);
-  gg_assert(tree.hashtable_even);
-  tree.num_nodes = nodes;
-  tree.num_arcs = nodes;
-  tree.num_used_nodes = 0;
-  tree.num_used_arcs = 0;
-  tree.forbidden_moves = forbidden_moves;
-  uct_init_node(&tree, allowed_moves);
-  uct_init_move_ordering(&tree);
-
-  /* Play simulations. FIXME: Terribly dirty fix. */
-  while (tree.num_used_arcs < tree.num_arcs - 10) {
-    int last_used_arcs = tree.num_used_arcs;
-    tree.game = starting_position;
-    uct_traverse_tree(&tree, &tree.nodes[0], 1.0, 0.9);
-    /* FIXME: Ugly workaround for solved positions before running out
-     * of nodes.
-     */
-    if (tree.num_used_arcs == last_used_arcs)
-      break;
+  uct_ponder_stop();
+  uct_analyze_stop();
+
+  uct_init_starting_position(&starting_position, color, forbidden_moves);
+  if (mc_memory > 0.0) {
+    uct_prepare_tree(tree, &starting_position,
+		     uct_nodes_for_memory(mc_memory), forbidden_moves,
+		     allowed_moves);
+    tree->recycle = 1;
+    tree->max_games = (time_limit > 0.0 ? 0 : games);
+  }
+  else {
+    uct_prepare_tree(tree, &starting_position, games, forbidden_moves,
+		     allowed_moves);
+    tree->recycle = 0;
+    tree->max_games = 0;
+  }
+
+  /* Play simulations. */
+  tree->analyzing = 0;
+  tree->stop = 0;
+  uct_run_search(tree, time_limit);
+
+  if (mc_debug) {
+    gprintf("%d games in %f seconds.\n",
+	    tree->nodes[0].games - tree->start_games,
+	    gg_gettimeofday() - tree->start_time);
+    gprintf("%d of %d nodes and %d of %d arcs used.\n",
+	    tree->num_used_nodes, tree->num_nodes,
+	    gg_min(tree->num_used_arcs, tree->num_arcs), tree->num_arcs);
   }
 
   /* Identify the best move on the top level. */
+  root = &tree->nodes[0];
   best_score = 0.0;
   *move = PASS_MOVE;
-  for (arc = tree.nodes[0].child; arc; arc = arc->next) {
+  for (k = root->num_children - 1; k >= 0; k--) {
+    arc = &root->children[k];
     node = arc->node;
     move_frequencies[arc->move] = node->games;
     move_values[arc->move] = (float) node->wins / node->games;
@@ -2184,7 +3903,7 @@ uct_genmove(int color, int *move, int *forbidden_moves, int *allowed_moves,
 
   /* Dump sgf tree of the significant part of the search tree. */
   if (0)
-    uct_dump_tree(&tree, "/tmp/ucttree.sgf", color, 50);
+    uct_dump_tree(tree, "/tmp/ucttree.sgf", color, 50);
     
   /* Print information about the search tree. */
   if (mc_debug) {
@@ -2196,7 +3915,8 @@ uct_genmove(int color, int *move, int *forbidden_moves, int *allowed_moves,
       most_games_node = NULL;
       most_games_arc = NULL;
       
-      for (arc = tree.nodes[0].child; arc; arc = arc->next) {
+      for (k = root->num_children - 1; k >= 0; k--) {
+	arc = &root->children[k];
 	node = arc->node;
 	if (most_games < node->games) {
 	  most_games = node->games;
@@ -2217,17 +3937,16 @@ uct_genmove(int color, int *move, int *forbidden_moves, int *allowed_moves,
 	      mean, std, mean / (std + 0.001));
       most_games_node->games = -most_games_node->games;
     }
-    for (arc = tree.nodes[0].child; arc; arc = arc->next)
-      arc->node->games = -arc->node->games;
+    for (k = 0; k < root->num_children; k++)
+      root->children[k].node->games = -root->children[k].node->games;
     
     {
       int n;
       struct uct_arc *arcs[7];
       int depth = 0;
-      n = uct_find_best_children(&tree.nodes[0], arcs, 7);
+      n = uct_find_best_children(&tree->nodes[0], arcs, 7);
       gprintf("Principal variation:\n");
       while (n > 0 && depth < 80) {
-	int k;
 	gprintf("%C ", color);
 	for (k = 0; k < n; k++) {
 	  node = arcs[k]->node;
@@ -2246,11 +3965,106 @@ uct_genmove(int color, int *move, int *forbidden_moves, int *allowed_moves,
       gprintf("\n");
     }
   }
-  
-  free(tree.nodes);
-  free(tree.arcs);
-  free(tree.hashtable_odd);
-  free(tree.hashtable_even);
+}
+
+
+/******************* Benchmarking ***********************/
+
+/* Play num_playouts random games from the current position, with
+ * color to move and the pattern values in use, and report the speed.
+ *
+ * The time spent in the playout functions is too short to measure
+ * call by call, so the move sequences of the games are recorded and
+ * replayed, first with only mc_play_move() and then also with
+ * mc_update_move_values(). The remaining time of the full playouts,
+ * including the final scoring, is attributed to
+ * mc_generate_random_move().
+ */
+void
+mc_benchmark(int color, int num_playouts, struct mc_benchmark_result *result)
+{
+  int forbidden_moves[BOARDMAX];
+  struct mc_game *starting_position = malloc(sizeof(*starting_position));
+  struct mc_game *game = malloc(sizeof(*game));
+  struct mc_ladder_cache *ladder_cache = calloc(1, sizeof(*ladder_cache));
+  int *lengths = malloc(num_playouts * sizeof(*lengths));
+  int max_moves = 100 * num_playouts;
+  int num_moves = 0;
+  short *moves = malloc(max_moves * sizeof(*moves));
+  int max_length = sizeof(game->move_history) / sizeof(game->move_history[0]);
+  double copy_time;
+  double play_time;
+  double update_time;
+  double start;
+  int k;
+  int n;
+  int m;
+  int c;
+  volatile int sink = 0;
+
+  gg_assert(starting_position && game && ladder_cache && lengths && moves);
+
+  memset(forbidden_moves, 0, sizeof(forbidden_moves));
+  uct_init_starting_position(starting_position, color, forbidden_moves);
+  starting_position->ladder_cache = ladder_cache;
+
+  /* Full playouts. */
+  start = gg_gettimeofday();
+  for (k = 0; k < num_playouts; k++) {
+    *game = *starting_position;
+    mc_play_random_game(game);
+    lengths[k] = gg_min(game->depth, max_length);
+    if (num_moves + lengths[k] > max_moves) {
+      max_moves = 2 * max_moves + lengths[k];
+      moves = realloc(moves, max_moves * sizeof(*moves));
+      gg_assert(moves);
+    }
+    for (m = 0; m < lengths[k]; m++)
+      moves[num_moves++] = game->move_history[m];
+  }
+  result->total_time = gg_gettimeofday() - start;
+
+  /* Only copying the starting position. */
+  start = gg_gettimeofday();
+  for (k = 0; k < num_playouts; k++) {
+    *game = *starting_position;
+    sink += game->depth;
+  }
+  copy_time = gg_gettimeofday() - start;
+
+  /* Replay with mc_play_move(). */
+  start = gg_gettimeofday();
+  for (k = 0, n = 0; k < num_playouts; k++) {
+    *game = *starting_position;
+    for (m = 0, c = color; m < lengths[k]; m++, c = OTHER_COLOR(c))
+      mc_play_move(&game->mc, moves[n++], c);
+  }
+  play_time = gg_gettimeofday() - start;
+
+  /* Replay with mc_play_move() and mc_update_move_values(). */
+  start = gg_gettimeofday();
+  for (k = 0, n = 0; k < num_playouts; k++) {
+    *game = *starting_position;
+    for (m = 0, c = color; m < lengths[k]; m++, c = OTHER_COLOR(c)) {
+      mc_play_move(&game->mc, moves[n++], c);
+      mc_update_move_values(&game->mc);
+    }
+  }
+  update_time = gg_gettimeofday() - start;
+
+  result->playouts_per_second = num_playouts / gg_max(result->total_time,
+						      1e-6);
+  result->average_length = (double) num_moves / num_playouts;
+  result->play_move_time = gg_max(play_time - copy_time, 0.0);
+  result->update_move_values_time = gg_max(update_time - play_time, 0.0);
+  result->generate_random_move_time = gg_max(result->total_time
+					     - update_time, 0.0);
+
+  free(starting_position);
+  free(ladder_cache);
+  free(game);
+  free(lengths);
+  free(moves);
 }
 
 
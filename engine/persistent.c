@@ -51,6 +51,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "liberty.h"
 #include "cache.h"
 
@@ -81,6 +82,27 @@
 
 #define MAX_CACHE_DEPTH 	5
 
+/* Number of chains in the index of each cache. Power of two. */
+#define PERSISTENT_CACHE_INDEX_SIZE 256
+
+/* Number of entries initially allocated for a cache. The table grows
+ * as needed up to the capacity of the cache.
+ */
+#define PERSISTENT_CACHE_INITIAL_SIZE 256
+
+/* Number of words in a bitmap with one bit per intersection. */
+#define POINT_BITMAP_WORDS ((BOARDMAX + 31) / 32)
+#define POINT_BITMAP_SET(bitmap, pos) \
+  ((bitmap)[(pos) / 32] |= 1U << ((pos) % 32))
+
+
+/* A point of the active area together with its stored board value,
+ * i.e. the color and possibly HIGH_LIBERTY_BIT or HIGH_LIBERTY_BIT2.
+ */
+struct persistent_cache_point {
+  unsigned short pos;
+  Intersection value;
+};
 
 /* We use the same data structure for all of the caches. Some of the entries
  * below are unused for some of the caches.
@@ -88,7 +110,9 @@
 struct persistent_cache_entry {
   int boardsize;
   int movenum;
-  Intersection board[BOARDMAX];
+  int num_active; /* Number of points in the active area. */
+  struct persistent_cache_point *active; /* The active area, by position. */
+  unsigned int active_hash; /* See hash_active_area(). */
   int stack[MAX_CACHE_DEPTH];
   int move_color[MAX_CACHE_DEPTH];
   enum routine_id routine;
@@ -106,17 +130,23 @@ struct persistent_cache_entry {
   int move2;/* second result coordinate */
   int cost; /* Usually no. of tactical nodes spent on this reading result. */
   int score; /* Heuristic guess of the worth of the cache entry. */
+  int next; /* Next entry in the same index chain, or -1. */
+  /* Set when depends[] is valid for the board at the last purge. */
+  int verified;
+  /* Intersections where a change may invalidate the entry. */
+  unsigned int depends[POINT_BITMAP_WORDS];
 };
 
 /* Callback function that implements the computation of the active area.
  * This function has to be provided by each cache.
  */
 typedef void (*compute_active_area_fn)(struct persistent_cache_entry *entry,
+				       Intersection active_board[BOARDMAX],
 				       const signed char goal[BOARDMAX],
 				       int goal_color);
 
 struct persistent_cache {
-  const int max_size; /* Size of above array. */
+  int max_size; /* Maximum number of entries. */
   const int max_stackp; /* Don't store positions with stackp > max_stackp. */
   const float age_factor; /* Reduce value of old entries with this factor. */
   const char *name; /* For debugging purposes. */
@@ -124,23 +154,40 @@ struct persistent_cache {
   struct persistent_cache_entry *table; /* Array of actual results. */
   int current_size; /* Current number of entries. */
   int last_purge_position_number;
+  /* First entry of each chain of entries with the same index, see
+   * persistent_cache_index(), or -1.
+   */
+  int *index;
+  int table_size; /* Number of entries allocated in table. */
+  size_t max_memory; /* Bound on memory, 0 if only max_size applies. */
+  size_t memory; /* Memory used by the current entries. */
+  /* The board at the last purge, used to find the intersections that
+   * have changed since then. Unused while purge_board_size is 0.
+   */
+  Intersection purge_board[BOARDMAX];
+  int purge_board_size;
 };
 
 static void compute_active_owl_area(struct persistent_cache_entry *entry,
+				    Intersection active_board[BOARDMAX],
 				    const signed char goal[BOARDMAX],
 				    int goal_color);
 static void compute_active_semeai_area(struct persistent_cache_entry *entry,
+				       Intersection active_board[BOARDMAX],
 				       const signed char goal[BOARDMAX],
 				       int dummy);
 static void compute_active_reading_area(struct persistent_cache_entry *entry,
+					Intersection active_board[BOARDMAX],
 					const signed char
 					    reading_shadow[BOARDMAX],
 					int dummy);
 static void compute_active_connection_area(struct persistent_cache_entry *entry,
+					   Intersection active_board[BOARDMAX],
 					   const signed char
 					   	connection_shadow[BOARDMAX],
 					   int goal_color);
 static void compute_active_breakin_area(struct persistent_cache_entry *entry,
+				        Intersection active_board[BOARDMAX],
 				        const signed char
 					    breakin_shadow[BOARDMAX],
 				        int dummy);
@@ -148,27 +195,27 @@ static void compute_active_breakin_area(struct persistent_cache_entry *entry,
 static struct persistent_cache reading_cache =
   { MAX_READING_CACHE_SIZE, MAX_READING_CACHE_DEPTH, 1.0,
     "reading cache", compute_active_reading_area,
-    NULL, 0, -1 };
+    NULL, 0, -1, NULL, 0, 0, 0, {0}, 0 };
 
 static struct persistent_cache connection_cache =
   { MAX_CONNECTION_CACHE_SIZE, MAX_CONNECTION_CACHE_DEPTH, 1.0,
     "connection cache", compute_active_connection_area,
-    NULL, 0, -1 };
+    NULL, 0, -1, NULL, 0, 0, 0, {0}, 0 };
 
 static struct persistent_cache breakin_cache =
   { MAX_BREAKIN_CACHE_SIZE, MAX_BREAKIN_CACHE_DEPTH, 0.75,
     "breakin cache", compute_active_breakin_area,
-    NULL, 0, -1 };
+    NULL, 0, -1, NULL, 0, 0, 0, {0}, 0 };
 
 static struct persistent_cache owl_cache =
   { MAX_OWL_CACHE_SIZE, MAX_OWL_CACHE_DEPTH, 1.0,
     "owl cache", compute_active_owl_area,
-    NULL, 0, -1 };
+    NULL, 0, -1, NULL, 0, 0, 0, {0}, 0 };
 
 static struct persistent_cache semeai_cache =
   { MAX_SEMEAI_CACHE_SIZE, MAX_SEMEAI_CACHE_DEPTH, 0.75,
     "semeai cache", compute_active_semeai_area,
-    NULL, 0, -1 };
+    NULL, 0, -1, NULL, 0, 0, 0, {0}, 0 };
 
 /* ================================================================ */
 /* Common helper functions.   		                            */
@@ -218,24 +265,22 @@ draw_active_area(Intersection board[BOARDMAX], int apos)
 }
 
 
-/* Returns 1 if the stored board is compatible with the current board,
- * 0 otherwise.
+/* Returns 1 if the stored active area is compatible with the current
+ * board, 0 otherwise.
  */
 static int
-verify_stored_board(Intersection p[BOARDMAX])
+verify_stored_board(struct persistent_cache_entry *entry)
 {
-  int pos;
-  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
-    if (!ON_BOARD(pos))
-      continue;
-    else if (p[pos] == GRAY)
-      continue;
-    else if ((p[pos] & 3) != board[pos])
+  int k;
+  for (k = 0; k < entry->num_active; k++) {
+    int pos = entry->active[k].pos;
+    int value = entry->active[k].value;
+    if ((value & 3) != board[pos])
       return 0;
-    else if (!(p[pos] & (HIGH_LIBERTY_BIT | HIGH_LIBERTY_BIT2)))
+    else if (!(value & (HIGH_LIBERTY_BIT | HIGH_LIBERTY_BIT2)))
       continue;
-    else if (((p[pos] & HIGH_LIBERTY_BIT) && countlib(pos) <= 4)
-             || (p[pos] & HIGH_LIBERTY_BIT2 && countlib(pos) <= 3))
+    else if (((value & HIGH_LIBERTY_BIT) && countlib(pos) <= 4)
+             || (value & HIGH_LIBERTY_BIT2 && countlib(pos) <= 3))
       return 0;
   }
   
@@ -243,6 +288,48 @@ verify_stored_board(Intersection p[BOARDMAX])
 }
 
 
+/* Expand the active area of an entry to a board with GRAY outside of
+ * the active area.
+ */
+static void
+expand_active_area(struct persistent_cache_entry *entry,
+		   Intersection active_board[BOARDMAX])
+{
+  int pos;
+  int k;
+  for (pos = 0; pos < BOARDMAX; pos++)
+    active_board[pos] = GRAY;
+  for (k = 0; k < entry->num_active; k++)
+    active_board[entry->active[k].pos] = entry->active[k].value;
+}
+
+
+/* Hash of the points and values in an active area. Entries with the
+ * same input data and active area hash are compared in full when a
+ * new result is stored, see store_persistent_cache().
+ */
+static unsigned int
+hash_active_area(struct persistent_cache_point *points, int num_points)
+{
+  unsigned int h = 2166136261U;
+  int k;
+  for (k = 0; k < num_points; k++) {
+    h = (h ^ points[k].pos) * 16777619U;
+    h = (h ^ points[k].value) * 16777619U;
+  }
+  return h;
+}
+
+
+/* Memory used by an entry with the given number of active points. */
+static size_t
+persistent_cache_entry_memory(int num_active)
+{
+  return (sizeof(struct persistent_cache_entry)
+	  + num_active * sizeof(struct persistent_cache_point));
+}
+
+
 /* Prints out all relevant information for a cache entry, and prints
  * a board showing the active area.
  */
@@ -250,6 +337,7 @@ static void
 print_persistent_cache_entry(struct persistent_cache_entry *entry)
 {
   int r;
+  Intersection active_board[BOARDMAX];
 
   gprintf("%omovenum         = %d\n",  entry->movenum);
   gprintf("%oscore	     = %d\n",  entry->score);
@@ -279,7 +367,8 @@ print_persistent_cache_entry(struct persistent_cache_entry *entry)
 	    entry->stack[r]);
   }
 
-  draw_active_area(entry->board, entry->apos);
+  expand_active_area(entry, active_board);
+  draw_active_area(active_board, entry->apos);
 }
 
 /* To keep GCC happy and have the function included in the
@@ -309,14 +398,130 @@ print_persistent_cache(struct persistent_cache *cache)
  * function below.
  */
 
+/* Index of the chain for entries with the given input data. */
+static int
+persistent_cache_index(enum routine_id routine, int apos, int bpos,
+		       int cpos, int color)
+{
+  unsigned int h = routine;
+  h = h * 31 + apos;
+  h = h * 31 + bpos;
+  h = h * 31 + cpos;
+  h = h * 4 + color;
+  h ^= h >> 8;
+  return h & (PERSISTENT_CACHE_INDEX_SIZE - 1);
+}
+
+
+/* Add entry k to its index chain. The chains are kept sorted by entry
+ * number, so that lookups find the same entry as a scan through the
+ * table would.
+ */
+static void
+link_persistent_cache_entry(struct persistent_cache *cache, int k)
+{
+  struct persistent_cache_entry *entry = &(cache->table[k]);
+  int *link = &(cache->index[persistent_cache_index(entry->routine,
+						    entry->apos, entry->bpos,
+						    entry->cpos,
+						    entry->color)]);
+  while (*link != -1 && *link < k)
+    link = &(cache->table[*link].next);
+  entry->next = *link;
+  *link = k;
+}
+
+
+/* Remove entry k from its index chain. */
+static void
+unlink_persistent_cache_entry(struct persistent_cache *cache, int k)
+{
+  struct persistent_cache_entry *entry = &(cache->table[k]);
+  int *link = &(cache->index[persistent_cache_index(entry->routine,
+						    entry->apos, entry->bpos,
+						    entry->cpos,
+						    entry->color)]);
+  while (*link != k) {
+    gg_assert(*link != -1);
+    link = &(cache->table[*link].next);
+  }
+  *link = entry->next;
+}
+
+
+/* Remove entry k from the cache by moving the last entry into its
+ * place.
+ */
+static void
+remove_persistent_cache_entry(struct persistent_cache *cache, int k)
+{
+  int last = cache->current_size - 1;
+  struct persistent_cache_entry *entry = &(cache->table[k]);
+  unlink_persistent_cache_entry(cache, k);
+  cache->memory -= persistent_cache_entry_memory(entry->num_active);
+  free(entry->active);
+  if (k < last) {
+    unlink_persistent_cache_entry(cache, last);
+    cache->table[k] = cache->table[last];
+    link_persistent_cache_entry(cache, k);
+  }
+  cache->current_size--;
+}
+
+
+/* Compute the intersections that the validity of an entry stored at
+ * stackp == 0 depends on. These are the points of the active area and,
+ * for strings whose liberties were recorded with HIGH_LIBERTY_BIT or
+ * HIGH_LIBERTY_BIT2, all stones of the string and their neighbors.
+ * As long as none of these points changes, verify_stored_board()
+ * keeps succeeding for the entry.
+ */
+static void
+compute_persistent_cache_dependencies(struct persistent_cache_entry *entry)
+{
+  signed char strings[BOARDMAX];
+  int pos;
+  int k;
+  gg_assert(stackp == 0);
+
+  memset(entry->depends, 0, sizeof(entry->depends));
+  memset(strings, 0, sizeof(strings));
+  for (k = 0; k < entry->num_active; k++) {
+    pos = entry->active[k].pos;
+    POINT_BITMAP_SET(entry->depends, pos);
+    if ((entry->active[k].value & (HIGH_LIBERTY_BIT | HIGH_LIBERTY_BIT2))
+	&& IS_STONE(board[pos]) && !strings[pos])
+      mark_string(pos, strings, 1);
+  }
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    if (!strings[pos])
+      continue;
+    POINT_BITMAP_SET(entry->depends, pos);
+    for (k = 0; k < 4; k++)
+      if (ON_BOARD(pos + delta[k]))
+	POINT_BITMAP_SET(entry->depends, pos + delta[k]);
+  }
+
+  entry->verified = 1;
+}
+
+
 /* Remove persistent cache entries which are no longer compatible with
  * the board. For efficient use of the cache, it's recommended to call
  * this function once per move, before starting the owl reading. It's
  * not required for correct operation though. 
+ *
+ * Only entries depending on an intersection that has changed since the
+ * last purge need to be verified again. Entries stored since then, and
+ * entries stored with moves on the stack, are always verified.
  */
 static void
 purge_persistent_cache(struct persistent_cache *cache)
 {
+  unsigned int changed[POINT_BITMAP_WORDS];
+  int incremental = (cache->purge_board_size == board_size);
+  int pos;
   int k;
   int r;
   gg_assert(stackp == 0);
@@ -327,11 +532,28 @@ purge_persistent_cache(struct persistent_cache *cache)
   else
     cache->last_purge_position_number = position_number;
 
+  if (incremental) {
+    memset(changed, 0, sizeof(changed));
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      if (ON_BOARD(pos) && board[pos] != cache->purge_board[pos])
+	POINT_BITMAP_SET(changed, pos);
+  }
+
   for (k = 0; k < cache->current_size; k++) {
     int played_moves = 0;
     int entry_ok = 1;
     struct persistent_cache_entry *entry = &(cache->table[k]);
 
+    if (incremental && entry->verified && entry->boardsize == board_size) {
+      int affected = 0;
+      for (r = 0; r < POINT_BITMAP_WORDS; r++)
+	affected |= (entry->depends[r] & changed[r]) != 0;
+      if (!affected) {
+	entry->score *= cache->age_factor;
+	continue;
+      }
+    }
+
     if (entry->boardsize != board_size)
       entry_ok = 0;
     else {
@@ -351,20 +573,20 @@ purge_persistent_cache(struct persistent_cache *cache)
     }
 
     if (!entry_ok 
-	|| !verify_stored_board(entry->board)) {
+	|| !verify_stored_board(entry)) {
       /* Move the last entry in the cache here and back up the loop
        * counter to redo the test at this position in the cache.
        */
       if (0)
 	gprintf("Purging entry %d from cache.\n", k);
-      if (k < cache->current_size - 1)
-	*entry = cache->table[cache->current_size - 1];
+      remove_persistent_cache_entry(cache, k);
       k--;
-      cache->current_size--;
     }
     else {
       /* Reduce score here to penalize entries getting old. */
       entry->score *= cache->age_factor;
+      if (entry->stack[0] == 0)
+	compute_persistent_cache_dependencies(entry);
     }
 
     while (played_moves > 0) {
@@ -372,12 +594,19 @@ purge_persistent_cache(struct persistent_cache *cache)
       played_moves--;
     }
   }
+
+  memcpy(cache->purge_board, board, sizeof(cache->purge_board));
+  cache->purge_board_size = board_size;
 }
 
 
 /* Find a cache entry matching the data given in the parameters.
  * Important: We assume that unused parameters are normalized to NO_MOVE
  * when storing or retrieving, so that we can ignore them here.
+ *
+ * Only the entries in the index chain for the input data need to be
+ * examined, and normally at most one of them gets as far as the
+ * comparison with the stored board.
  */ 
 static struct persistent_cache_entry *
 find_persistent_cache_entry(struct persistent_cache *cache,
@@ -386,7 +615,9 @@ find_persistent_cache_entry(struct persistent_cache *cache,
 			    Hash_data *goal_hash, int node_limit)
 {
   int k;
-  for (k = 0; k < cache->current_size; k++) {
+  for (k = cache->index[persistent_cache_index(routine, apos, bpos,
+					       cpos, color)];
+       k != -1; k = cache->table[k].next) {
     struct persistent_cache_entry *entry = cache->table + k;
     if (entry->routine == routine
 	&& entry->apos == apos
@@ -397,7 +628,7 @@ find_persistent_cache_entry(struct persistent_cache *cache,
         && (entry->node_limit >= node_limit || entry->result_certain)
         && (goal_hash == NULL
 	    || hashdata_is_equal(entry->goal_hash, *goal_hash))
-        && verify_stored_board(entry->board))
+        && verify_stored_board(entry))
       return entry;
   }
   return NULL;
@@ -457,8 +688,65 @@ search_persistent_cache(struct persistent_cache *cache,
   return 1;
 }
 
+/* Find an entry with the same input data, stack and active area as
+ * the given one, which is then superseded by it. Returns -1 if there
+ * is none.
+ */
+static int
+find_superseded_cache_entry(struct persistent_cache *cache,
+			    struct persistent_cache_entry *new_entry,
+			    int use_goal_hash)
+{
+  int k;
+  for (k = cache->index[persistent_cache_index(new_entry->routine,
+					       new_entry->apos,
+					       new_entry->bpos,
+					       new_entry->cpos,
+					       new_entry->color)];
+       k != -1; k = cache->table[k].next) {
+    struct persistent_cache_entry *entry = cache->table + k;
+    if (entry->routine == new_entry->routine
+	&& entry->apos == new_entry->apos
+	&& entry->bpos == new_entry->bpos
+	&& entry->cpos == new_entry->cpos
+	&& entry->color == new_entry->color
+	&& entry->boardsize == new_entry->boardsize
+	&& (!use_goal_hash
+	    || hashdata_is_equal(entry->goal_hash, new_entry->goal_hash))
+	&& memcmp(entry->stack, new_entry->stack, sizeof(entry->stack)) == 0
+	&& entry->active_hash == new_entry->active_hash
+	&& entry->num_active == new_entry->num_active
+	&& memcmp(entry->active, new_entry->active,
+		  entry->num_active * sizeof(entry->active[0])) == 0)
+      return k;
+  }
+  return -1;
+}
+
+
+/* Return 1 if there is no room for a new entry using the given
+ * memory, counting the entry superseded, if not -1, as removed.
+ */
+static int
+persistent_cache_is_full(struct persistent_cache *cache, size_t memory,
+			 int superseded)
+{
+  int size = cache->current_size;
+  size_t used = cache->memory;
+
+  if (superseded != -1) {
+    size--;
+    used -= persistent_cache_entry_memory(cache->table[superseded].num_active);
+  }
+
+  return (size == cache->max_size
+	  || (cache->max_memory > 0 && size > 0
+	      && used + memory > cache->max_memory));
+}
+
+
 /* Generic function that tries to store a cache entry. If the cache
- * is full, we delete the lowest scoring entry.
+ * is full, we delete the lowest scoring entries.
  *
  * Unused parameters have to be normalized to NO_MOVE by the calling
  * function.
@@ -474,35 +762,16 @@ store_persistent_cache(struct persistent_cache *cache,
 		       int goal_color)
 {
   int r;
-  struct persistent_cache_entry *entry;
+  int pos;
+  int superseded;
+  size_t memory;
+  struct persistent_cache_entry new_entry;
+  struct persistent_cache_entry *entry = &new_entry;
+  Intersection active_board[BOARDMAX];
+  struct persistent_cache_point active[BOARDMAX];
   if (stackp > cache->max_stackp)
     return;
 
-  /* If cache is still full, consider kicking out an old entry. */
-  if (cache->current_size == cache->max_size) {
-    int worst_entry = -1;
-    int worst_score = cost;
-    int k;
-
-    for (k = 0; k < cache->current_size; k++) {
-      if (cache->table[k].score < worst_score) {
-	worst_score = cache->table[k].score;
-	worst_entry = k;
-      }
-    }
-
-    if (worst_entry != -1) {
-      /* Move the last entry in the cache here to make space.
-       */
-      if (worst_entry < cache->current_size - 1)
-	cache->table[worst_entry] = cache->table[cache->current_size - 1];
-      cache->current_size--;
-    }
-    else
-      return;
-  }
-
-  entry = &(cache->table[cache->current_size]);
   entry->boardsize  	 = board_size;
   entry->routine    	 = routine;
   entry->apos	     	 = apos;
@@ -521,6 +790,7 @@ store_persistent_cache(struct persistent_cache *cache,
   entry->score 		 = cost;
   entry->cost 		 = cost;
   entry->movenum 	 = movenum;
+  entry->verified	 = 0;
 
   for (r = 0; r < MAX_CACHE_DEPTH; r++) {
     if (r < stackp)
@@ -531,9 +801,70 @@ store_persistent_cache(struct persistent_cache *cache,
     }
   }
   
-  /* Remains to set the board. */
-  cache->compute_active_area(&(cache->table[cache->current_size]),
-      			     goal, goal_color);
+  /* Compute the board and keep only its active area. */
+  cache->compute_active_area(entry, active_board, goal, goal_color);
+  entry->num_active = 0;
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    if (!ON_BOARD(pos) || active_board[pos] == GRAY)
+      continue;
+    active[entry->num_active].pos = pos;
+    active[entry->num_active].value = active_board[pos];
+    entry->num_active++;
+  }
+  entry->active = active;
+  entry->active_hash = hash_active_area(active, entry->num_active);
+  memory = persistent_cache_entry_memory(entry->num_active);
+
+  /* A result for the same input data and active area replaces the old
+   * one, which could not have been used for the current reading. It
+   * is only removed once the new entry is sure to be stored, but its
+   * room counts as free already.
+   */
+  superseded = find_superseded_cache_entry(cache, entry, goal_hash != NULL);
+
+  /* If cache is still full, consider kicking out old entries. */
+  while (persistent_cache_is_full(cache, memory, superseded)) {
+    int worst_entry = -1;
+    int worst_score = cost;
+    int k;
+
+    for (k = 0; k < cache->current_size; k++) {
+      if (k != superseded && cache->table[k].score < worst_score) {
+	worst_score = cache->table[k].score;
+	worst_entry = k;
+      }
+    }
+
+    if (worst_entry == -1)
+      return;
+
+    /* The last entry moves into the place of the removed one. */
+    if (superseded == cache->current_size - 1)
+      superseded = worst_entry;
+    remove_persistent_cache_entry(cache, worst_entry);
+  }
+
+  if (superseded == -1 && cache->current_size == cache->table_size) {
+    int table_size = gg_min(2 * cache->table_size, cache->max_size);
+    struct persistent_cache_entry *table;
+    table = realloc(cache->table, table_size * sizeof(*table));
+    if (table == NULL)
+      return;
+    cache->table = table;
+    cache->table_size = table_size;
+  }
+
+  entry->active = malloc(entry->num_active * sizeof(entry->active[0]) + 1);
+  if (entry->active == NULL)
+    return;
+  memcpy(entry->active, active, entry->num_active * sizeof(entry->active[0]));
+
+  if (superseded != -1)
+    remove_persistent_cache_entry(cache, superseded);
+  cache->table[cache->current_size] = new_entry;
+  entry = &(cache->table[cache->current_size]);
+  cache->memory += memory;
+  link_persistent_cache_entry(cache, cache->current_size);
   cache->current_size++;
 
   if (debug & DEBUG_PERSISTENT_CACHE) {
@@ -548,12 +879,41 @@ store_persistent_cache(struct persistent_cache *cache,
 /* Interface functions relevant to all caches.			    */
 /* ================================================================ */
 
-/* Allocate the actual cache table. */
+/* Discard all entries of a cache. */
+static void
+clear_cache(struct persistent_cache *cache)
+{
+  int k;
+  for (k = 0; k < cache->current_size; k++)
+    free(cache->table[k].active);
+  cache->current_size = 0;
+  cache->memory = 0;
+  for (k = 0; k < PERSISTENT_CACHE_INDEX_SIZE; k++)
+    cache->index[k] = -1;
+}
+
+/* Set the capacity of a cache from persistent_cache_entries and
+ * persistent_cache_memory and allocate its table and index. The
+ * memory is shared between the caches in proportion to their default
+ * number of entries, of which there are default_total in all caches.
+ */
 static void
-init_cache(struct persistent_cache *cache)
+init_cache(struct persistent_cache *cache, int default_total)
 {
-  cache->table = malloc(cache->max_size*sizeof(struct persistent_cache_entry));
-  gg_assert(cache->table);
+  if (persistent_cache_memory > 0.0)
+    cache->max_memory = (persistent_cache_memory * 1024 * 1024
+			 * cache->max_size / default_total);
+  if (persistent_cache_entries > 0)
+    cache->max_size = persistent_cache_entries;
+  else if (persistent_cache_memory > 0.0)
+    cache->max_size = INT_MAX;
+
+  cache->table_size = gg_min(cache->max_size, PERSISTENT_CACHE_INITIAL_SIZE);
+  cache->table = malloc(cache->table_size
+			* sizeof(struct persistent_cache_entry));
+  cache->index = malloc(PERSISTENT_CACHE_INDEX_SIZE * sizeof(int));
+  gg_assert(cache->table && cache->index);
+  clear_cache(cache);
 }
 
 /* Initializes all persistent caches.
@@ -562,11 +922,14 @@ init_cache(struct persistent_cache *cache)
 void
 persistent_cache_init()
 {
-  init_cache(&reading_cache);
-  init_cache(&breakin_cache);
-  init_cache(&connection_cache);
-  init_cache(&owl_cache);
-  init_cache(&semeai_cache);
+  int default_total = (reading_cache.max_size + breakin_cache.max_size
+		       + connection_cache.max_size + owl_cache.max_size
+		       + semeai_cache.max_size);
+  init_cache(&reading_cache, default_total);
+  init_cache(&breakin_cache, default_total);
+  init_cache(&connection_cache, default_total);
+  init_cache(&owl_cache, default_total);
+  init_cache(&semeai_cache, default_total);
 }
 
 
@@ -574,11 +937,11 @@ persistent_cache_init()
 void
 clear_persistent_caches()
 {
-  reading_cache.current_size = 0;
-  connection_cache.current_size = 0;
-  breakin_cache.current_size = 0;
-  owl_cache.current_size = 0;
-  semeai_cache.current_size = 0;
+  clear_cache(&reading_cache);
+  clear_cache(&connection_cache);
+  clear_cache(&breakin_cache);
+  clear_cache(&owl_cache);
+  clear_cache(&semeai_cache);
 }
 
 /* Discards all persistent cache entries that are no longer useful. 
@@ -625,6 +988,7 @@ store_persistent_reading_cache(enum routine_id routine, int str,
 
 static void
 compute_active_reading_area(struct persistent_cache_entry *entry,
+			    Intersection active_board[BOARDMAX],
 			    const signed char goal[BOARDMAX], int dummy)
 {
   signed char active[BOARDMAX];
@@ -707,7 +1071,7 @@ compute_active_reading_area(struct persistent_cache_entry *entry,
   for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
     if (!ON_BOARD(pos))
       continue;
-    entry->board[pos] = 
+    active_board[pos] = 
       active[pos] != 0 ? board[pos] : GRAY;
   }
 }
@@ -840,6 +1204,7 @@ store_persistent_connection_cache(enum routine_id routine,
  */
 static void
 compute_active_connection_area(struct persistent_cache_entry *entry,
+			       Intersection active_board[BOARDMAX],
 			       const signed char connection_shadow[BOARDMAX],
 			       int dummy)
 {
@@ -946,7 +1311,7 @@ compute_active_connection_area(struct persistent_cache_entry *entry,
     else if (IS_STONE(board[pos]) && countlib(pos) > 4 && active[pos] > 0)
       value |= HIGH_LIBERTY_BIT;
     
-    entry->board[pos] = value;
+    active_board[pos] = value;
   }
 
 }
@@ -989,6 +1354,7 @@ store_persistent_breakin_cache(enum routine_id routine,
  */
 static void
 compute_active_breakin_area(struct persistent_cache_entry *entry,
+			    Intersection active_board[BOARDMAX],
 			    const signed char breakin_shadow[BOARDMAX],
 			    int dummy)
 {
@@ -1092,7 +1458,7 @@ compute_active_breakin_area(struct persistent_cache_entry *entry,
     else if (IS_STONE(board[pos]) && countlib(pos) > 3 && active[pos] > 0)
       value |= HIGH_LIBERTY_BIT2;
     
-    entry->board[pos] = value;
+    active_board[pos] = value;
   }
 }
 
@@ -1218,6 +1584,7 @@ compute_active_owl_type_area(const signed char goal[BOARDMAX], int goal_color,
 
 static void
 compute_active_owl_area(struct persistent_cache_entry *entry,
+			Intersection active_board[BOARDMAX],
 			const signed char goal[BOARDMAX], int goal_color)
 {
   int pos;
@@ -1242,7 +1609,7 @@ compute_active_owl_area(struct persistent_cache_entry *entry,
     else if (IS_STONE(board[pos]) && countlib(pos) > 4 && active[pos] > 0)
       value |= HIGH_LIBERTY_BIT;
     
-    entry->board[pos] = value;
+    active_board[pos] = value;
   }
 }
 
@@ -1294,6 +1661,7 @@ store_persistent_semeai_cache(enum routine_id routine,
 
 static void
 compute_active_semeai_area(struct persistent_cache_entry *entry,
+			   Intersection active_board[BOARDMAX],
 			   const signed char goal[BOARDMAX], int dummy)
 {
   int pos;
@@ -1326,7 +1694,7 @@ compute_active_semeai_area(struct persistent_cache_entry *entry,
 	     && (active_b[pos] > 0 || active_w[pos] > 0))
       value |= HIGH_LIBERTY_BIT;
     
-    entry->board[pos] = value;
+    active_board[pos] = value;
   }
 }
 
@@ -1397,6 +1765,7 @@ owl_hotspots(float values[BOARDMAX])
   int libs[MAXLIBS];
   int liberties;
   int sum_tactical_nodes = 0;
+  Intersection active_board[BOARDMAX];
 
   /* Don't bother checking out of board. Set values[] to zero there too. */
   for (pos = BOARDMIN; pos < BOARDMAX; pos++)
@@ -1415,6 +1784,7 @@ owl_hotspots(float values[BOARDMAX])
   for (k = 0; k < owl_cache.current_size; k++) {
     struct persistent_cache_entry *entry = &(owl_cache.table[k]);
     float contribution = entry->score / (float) sum_tactical_nodes;
+    expand_active_area(entry, active_board);
     if (debug & DEBUG_PERSISTENT_CACHE) {
       gprintf("Owl hotspots: %d %1m %f\n", entry->routine, entry->apos,
 	      contribution);
@@ -1425,19 +1795,19 @@ owl_hotspots(float values[BOARDMAX])
     case OWL_DEFEND:
     case OWL_THREATEN_DEFENSE:
       mark_dragon_hotspot_values(values, entry->apos,
-				 contribution, entry->board);
+				 contribution, active_board);
       break;
     case OWL_DOES_DEFEND:
     case OWL_DOES_ATTACK:
     case OWL_CONFIRM_SAFETY:
       mark_dragon_hotspot_values(values, entry->bpos,
-				 contribution, entry->board);
+				 contribution, active_board);
       break;
     case OWL_CONNECTION_DEFENDS:
       mark_dragon_hotspot_values(values, entry->bpos,
-				 contribution, entry->board);
+				 contribution, active_board);
       mark_dragon_hotspot_values(values, entry->cpos,
-				 contribution, entry->board);
+				 contribution, active_board);
       break;
     case OWL_SUBSTANTIAL:
       /* Only consider the liberties of (apos). */
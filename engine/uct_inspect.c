@@ -0,0 +1,381 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Offline inspection of the binary search tree dumps written by the
+ * mc_dump_tree GTP command, see uctdump.h.
+ *
+ * Usage: uct_inspect [-k children] [-d depth] [-m moves] dumpfile
+ *
+ * Prints the most visited children of a node with their statistics
+ * and principal variations, followed by a histogram of the number of
+ * games of all nodes in the dump. The node is the root, or the one
+ * reached from it by the comma separated moves given with -m, e.g.
+ * "-m C5,D4".
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uctdump.h"
+
+#define WHITE 1
+#define BLACK 2
+#define OTHER_COLOR(color) (WHITE + BLACK - (color))
+
+static struct uct_dump_header header;
+static struct uct_dump_node *nodes;
+static struct uct_dump_arc *arcs;
+
+static const char letters[] = "ABCDEFGHJKLMNOPQRSTUVWXYZ";
+
+
+/* Free the nodes and arcs of the dump. */
+static void
+free_dump(void)
+{
+  free(nodes);
+  free(arcs);
+  nodes = NULL;
+  arcs = NULL;
+}
+
+
+/* Return 1 if move is a pass or a point on the board of the dump. */
+static int
+valid_move(int move)
+{
+  int i = move / (header.max_board + 1) - 1;
+  int j = move % (header.max_board + 1) - 1;
+
+  return (move == 0
+	  || (move > 0
+	      && i >= 0 && i < header.board_size
+	      && j >= 0 && j < header.board_size));
+}
+
+
+/* Read the dump in filename. Return 0 if it is not a valid dump. */
+static int
+load_dump(const char *filename)
+{
+  FILE *infile = fopen(filename, "rb");
+  int k;
+
+  if (!infile) {
+    fprintf(stderr, "uct_inspect: cannot open %s\n", filename);
+    return 0;
+  }
+
+  /* Moves are printed with letters[], which limits the board size. */
+  if (fread(&header, sizeof(header), 1, infile) != 1
+      || memcmp(header.magic, UCT_DUMP_MAGIC, sizeof(header.magic)) != 0
+      || header.version != UCT_DUMP_VERSION
+      || header.num_nodes <= 0
+      || header.num_arcs < 0
+      || header.board_size < 1
+      || header.board_size > header.max_board
+      || header.max_board > (int) strlen(letters)
+      || (header.root_color != WHITE && header.root_color != BLACK)) {
+    fprintf(stderr, "uct_inspect: %s is not a search tree dump\n", filename);
+    fclose(infile);
+    return 0;
+  }
+
+  nodes = malloc(header.num_nodes * sizeof(*nodes));
+  arcs = malloc((header.num_arcs + 1) * sizeof(*arcs));
+  if (!nodes || !arcs
+      || fread(nodes, sizeof(*nodes), header.num_nodes, infile)
+         != (size_t) header.num_nodes
+      || fread(arcs, sizeof(*arcs), header.num_arcs, infile)
+         != (size_t) header.num_arcs) {
+    fprintf(stderr, "uct_inspect: %s is truncated\n", filename);
+    fclose(infile);
+    free_dump();
+    return 0;
+  }
+  fclose(infile);
+
+  for (k = 0; k < header.num_nodes; k++)
+    if (nodes[k].first_arc < 0 || nodes[k].num_arcs < 0
+	|| nodes[k].num_arcs > header.num_arcs - nodes[k].first_arc) {
+      fprintf(stderr, "uct_inspect: %s is corrupt\n", filename);
+      free_dump();
+      return 0;
+    }
+  for (k = 0; k < header.num_arcs; k++)
+    if (arcs[k].node < 0 || arcs[k].node >= header.num_nodes
+	|| !valid_move(arcs[k].move)) {
+      fprintf(stderr, "uct_inspect: %s is corrupt\n", filename);
+      free_dump();
+      return 0;
+    }
+
+  return 1;
+}
+
+
+/* Write the move at pos to buf, which must hold at least 5 chars. */
+static void
+move_to_string(int pos, char *buf)
+{
+  int i = pos / (header.max_board + 1) - 1;
+  int j = pos % (header.max_board + 1) - 1;
+
+  if (pos == 0)
+    strcpy(buf, "PASS");
+  else
+    sprintf(buf, "%c%d", letters[j], header.board_size - i);
+}
+
+
+/* Parse a move like "C5" or "pass". Return -1 if it is invalid. */
+static int
+string_to_move(const char *s)
+{
+  const char *p = strchr(letters, toupper((unsigned char) *s));
+  int i;
+  int j;
+
+  if (strcmp(s, "pass") == 0 || strcmp(s, "PASS") == 0)
+    return 0;
+  if (!*s || !p || sscanf(s + 1, "%d", &i) != 1)
+    return -1;
+
+  j = p - letters;
+  i = header.board_size - i;
+  if (i < 0 || i >= header.board_size || j >= header.board_size)
+    return -1;
+
+  return (header.max_board + 2) + i * (header.max_board + 1) + j;
+}
+
+
+/* The child of node along the arc with the given move, or -1. */
+static int
+find_child(int node, int move)
+{
+  int k;
+  for (k = 0; k < nodes[node].num_arcs; k++)
+    if (arcs[nodes[node].first_arc + k].move == move)
+      return arcs[nodes[node].first_arc + k].node;
+
+  return -1;
+}
+
+
+/* Sort the arcs of node by decreasing number of games into children,
+ * which must have room for all of them. Return their number.
+ */
+static int
+sorted_children(int node, struct uct_dump_arc **children)
+{
+  int num_children = 0;
+  int k;
+  int m;
+
+  for (k = 0; k < nodes[node].num_arcs; k++) {
+    struct uct_dump_arc *arc = &arcs[nodes[node].first_arc + k];
+    int games = nodes[arc->node].games;
+    for (m = num_children;
+	 m > 0 && nodes[children[m - 1]->node].games < games; m--)
+      children[m] = children[m - 1];
+    children[m] = arc;
+    num_children++;
+  }
+
+  return num_children;
+}
+
+
+/* Print the principal variation from node, following the children with
+ * the most games.
+ */
+static void
+print_pv(int node, int depth)
+{
+  char buf[8];
+
+  while (depth-- > 0) {
+    int best = -1;
+    int k;
+    for (k = 0; k < nodes[node].num_arcs; k++) {
+      struct uct_dump_arc *arc = &arcs[nodes[node].first_arc + k];
+      if (nodes[arc->node].games > 0
+	  && (best < 0
+	      || nodes[arc->node].games > nodes[arcs[best].node].games))
+	best = nodes[node].first_arc + k;
+    }
+    if (best < 0)
+      break;
+    move_to_string(arcs[best].move, buf);
+    printf(" %s", buf);
+    node = arcs[best].node;
+  }
+}
+
+
+/* Print the statistics of the most visited children of node, where
+ * color is to move.
+ */
+static void
+print_children(int node, int color, int max_children, int depth)
+{
+  struct uct_dump_arc **children;
+  int num_children;
+  int k;
+
+  children = malloc((nodes[node].num_arcs + 1) * sizeof(*children));
+  if (!children)
+    return;
+  num_children = sorted_children(node, children);
+
+  printf("%-5s %8s %7s %8s %8s %7s  %s\n",
+	 "move", "games", "winrate", "score", "stddev", "amaf", "pv");
+  for (k = 0; k < num_children && k < max_children; k++) {
+    struct uct_dump_node *child = &nodes[children[k]->node];
+    char buf[8];
+    double mean = 0.0;
+    double variance = 0.0;
+
+    if (child->games <= 0)
+      break;
+
+    /* The scores are counted for white. */
+    mean = child->sum_scores / child->games;
+    if (child->games > 1)
+      variance = ((child->sum_scores2 - child->sum_scores * mean)
+		  / (child->games - 1));
+    if (color == BLACK)
+      mean = -mean;
+
+    move_to_string(children[k]->move, buf);
+    printf("%-5s %8d %7.4f %8.1f %8.1f ", buf, child->games,
+	   (double) child->wins / child->games, mean,
+	   sqrt(variance > 0.0 ? variance : 0.0));
+    if (child->amaf_games > 0)
+      printf("%7.4f ", (double) child->amaf_wins / child->amaf_games);
+    else
+      printf("%7s ", "-");
+    printf(" %s", buf);
+    print_pv(children[k]->node, depth - 1);
+    printf("\n");
+  }
+
+  free(children);
+}
+
+
+/* Print how many nodes have 0, 1, 2-3, 4-7, ... games. */
+static void
+print_histogram(void)
+{
+  int counts[33];
+  int max_bucket = 0;
+  int k;
+
+  memset(counts, 0, sizeof(counts));
+  for (k = 0; k < header.num_nodes; k++) {
+    int games = nodes[k].games;
+    int bucket = 0;
+    while (games > 0) {
+      bucket++;
+      games >>= 1;
+    }
+    counts[bucket]++;
+    if (bucket > max_bucket)
+      max_bucket = bucket;
+  }
+
+  printf("\n%-12s %8s\n", "games", "nodes");
+  for (k = 0; k <= max_bucket; k++) {
+    char label[32];
+    if (k <= 1)
+      sprintf(label, "%d", k);
+    else
+      sprintf(label, "%u-%u", 1U << (k - 1), (1U << (k - 1)) * 2 - 1);
+    printf("%-12s %8d\n", label, counts[k]);
+  }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  int max_children = 10;
+  int depth = 10;
+  char *moves = NULL;
+  int node = 0;
+  int color;
+  char *move;
+  int k;
+
+  for (k = 1; k < argc - 1 && argv[k][0] == '-'; k += 2) {
+    if (strcmp(argv[k], "-k") == 0)
+      max_children = atoi(argv[k + 1]);
+    else if (strcmp(argv[k], "-d") == 0)
+      depth = atoi(argv[k + 1]);
+    else if (strcmp(argv[k], "-m") == 0)
+      moves = argv[k + 1];
+    else
+      break;
+  }
+
+  if (k != argc - 1) {
+    fprintf(stderr,
+	    "Usage: uct_inspect [-k children] [-d depth] [-m moves] dumpfile\n");
+    return EXIT_FAILURE;
+  }
+
+  if (!load_dump(argv[k]))
+    return EXIT_FAILURE;
+
+  color = header.root_color;
+  if (moves) {
+    for (move = strtok(moves, ","); move; move = strtok(NULL, ",")) {
+      int pos = string_to_move(move);
+      if (pos >= 0)
+	node = find_child(node, pos);
+      if (pos < 0 || node < 0) {
+	fprintf(stderr, "uct_inspect: no node for move %s\n", move);
+	free_dump();
+	return EXIT_FAILURE;
+      }
+      color = OTHER_COLOR(color);
+    }
+  }
+
+  printf("Board size %d, komi %.1f, %d nodes, %d arcs.\n",
+	 header.board_size, header.komi, header.num_nodes, header.num_arcs);
+  printf("%s to move, %d games, %d children.\n\n",
+	 color == WHITE ? "White" : "Black", nodes[node].games,
+	 nodes[node].num_arcs);
+
+  print_children(node, color, max_children, depth);
+  print_histogram();
+  free_dump();
+
+  return EXIT_SUCCESS;
+}
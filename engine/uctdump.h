@@ -0,0 +1,84 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _UCTDUMP_H_
+#define _UCTDUMP_H_
+
+/* Binary dump of the Monte Carlo search tree, written by
+ * uct_dump_search_tree() and read by the uct_inspect utility.
+ *
+ * The file consists of a struct uct_dump_header followed by num_nodes
+ * struct uct_dump_node and num_arcs struct uct_dump_arc. All fields
+ * are 32 bit integers or floats in the byte order of the machine
+ * which wrote the dump.
+ *
+ * Node 0 is the root, with root_color to move (1 for white, 2 for
+ * black as in board.h). The children of a node are the num_arcs arcs
+ * starting at first_arc. Since transpositions share nodes, a node may
+ * be the child of several others. The wins of a node count for the
+ * color which moved into it and the scores are counted for white.
+ *
+ * Moves are given as board positions in the one-dimensional layout of
+ * board.h for a MAX_BOARD of max_board, with 0 for pass.
+ */
+
+#define UCT_DUMP_MAGIC   "GNUGOUCT"
+#define UCT_DUMP_VERSION 1
+
+struct uct_dump_header {
+  char magic[8];
+  int version;
+  int max_board;
+  int board_size;
+  int root_color;
+  float komi;
+  int num_nodes;
+  int num_arcs;
+};
+
+struct uct_dump_node {
+  unsigned int hash[2];
+  int wins;
+  int games;
+  int amaf_wins;
+  int amaf_games;
+  float sum_scores;
+  float sum_scores2;
+  int first_arc;
+  int num_arcs;
+};
+
+struct uct_dump_arc {
+  int move;
+  int node;
+};
+
+#endif  /* _UCTDUMP_H_ */
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -1981,7 +1981,7 @@ showstats()
  * patterns.h.
  */
 int
-choose_mc_patterns(char *name)
+choose_mc_patterns(const char *name)
 {
   int k;
   for (k = 0; mc_pattern_databases[k].name; k++) {
@@ -1994,6 +1994,20 @@ choose_mc_patterns(char *name)
   return 0;
 }
 
+/* Return the name of compiled in Monte Carlo pattern database number
+ * k, or NULL if there are not that many.
+ */
+const char *
+mc_pattern_database_name(int k)
+{
+  int n;
+  for (n = 0; n < k; n++)
+    if (!mc_pattern_databases[n].name)
+      return NULL;
+
+  return mc_pattern_databases[k].name;
+}
+
 /* List compiled in Monte Carlo pattern databases. */
 void
 list_mc_patterns(void)
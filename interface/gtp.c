@@ -63,6 +63,10 @@ static int gtp_boardsize = -1;
 static gtp_transform_ptr vertex_transform_input_hook = NULL;
 static gtp_transform_ptr vertex_transform_output_hook = NULL;
 
+/* Idle hooks, called around waiting for the next command. */
+static gtp_idle_ptr idle_start_hook = NULL;
+static gtp_idle_ptr idle_stop_hook = NULL;
+
 /* Current id number. We keep track of this internally rather than
  * pass it to the functions processing the commands, since those can't
  * do anything useful with it anyway.
@@ -91,8 +95,15 @@ gtp_main_loop(struct gtp_command commands[],
   gtp_output_file = gtp_output;
 
   while (status == GTP_OK) {
+    char *got_line;
+
     /* Read a line from gtp_input. */
-    if (!fgets(line, GTP_BUFSIZE, gtp_input))
+    if (idle_start_hook != NULL)
+      (*idle_start_hook)();
+    got_line = fgets(line, GTP_BUFSIZE, gtp_input);
+    if (idle_stop_hook != NULL)
+      (*idle_stop_hook)();
+    if (!got_line)
       break; /* EOF or some error */
 
     if (gtp_dump_commands) {
@@ -170,6 +181,19 @@ gtp_set_vertex_transform_hooks(gtp_transform_ptr in, gtp_transform_ptr out)
   vertex_transform_output_hook = out;
 }
 
+/* If you want to do something useful while waiting for the next
+ * command, use this function to set hook functions which are called
+ * before and after each command is read. The stop hook must end any
+ * work started by the start hook. In GNU Go this is used for
+ * pondering.
+ */
+void
+gtp_set_idle_hooks(gtp_idle_ptr start, gtp_idle_ptr stop)
+{
+  idle_start_hook = start;
+  idle_stop_hook = stop;
+}
+
 /*
  * This function works like printf, except that it only understands
  * very few of the standard formats, to be precise %c, %d, %f, %s.
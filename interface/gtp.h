@@ -62,6 +62,9 @@ typedef int (*gtp_fn_ptr)(char *s);
 /* Function pointer for vertex transform functions. */
 typedef void (*gtp_transform_ptr)(int ai, int aj, int *bi, int *bj);
 
+/* Function pointer for idle hook functions. */
+typedef void (*gtp_idle_ptr)(void);
+
 /* Elements in the array of commands required by gtp_main_loop. */
 struct gtp_command {
   const char *name;
@@ -73,6 +76,7 @@ void gtp_main_loop(struct gtp_command commands[],
 void gtp_internal_set_boardsize(int size);
 void gtp_set_vertex_transform_hooks(gtp_transform_ptr in,
 				    gtp_transform_ptr out);
+void gtp_set_idle_hooks(gtp_idle_ptr start, gtp_idle_ptr stop);
 void gtp_mprintf(const char *format, ...);
 void gtp_printf(const char *format, ...);
 void gtp_start_response(int status);
@@ -161,7 +161,16 @@ enum {OPT_BOARDSIZE = 127,
       OPT_MC_GAMES_PER_LEVEL,
       OPT_MC_PATTERNS,
       OPT_MC_LIST_PATTERNS,
-      OPT_MC_LOAD_PATTERNS
+      OPT_MC_LOAD_PATTERNS,
+      OPT_MC_USE_CLOCK,
+      OPT_MC_RAVE_EQUIVALENCE,
+      OPT_MC_MEMORY,
+      OPT_MC_WIDENING,
+      OPT_MC_LADDERS,
+      OPT_PERSISTENT_CACHE_ENTRIES,
+      OPT_PERSISTENT_CACHE_MEMORY,
+      OPT_PONDER,
+      OPT_THREADS
 };
 
 /* names of playing modes */
@@ -312,6 +321,17 @@ static struct gg_option const long_options[] =
   {"mc-patterns",    required_argument, 0, OPT_MC_PATTERNS},
   {"mc-list-patterns", no_argument,     0, OPT_MC_LIST_PATTERNS},
   {"mc-load-patterns", required_argument, 0, OPT_MC_LOAD_PATTERNS},
+  {"mc-use-clock",   no_argument,       0, OPT_MC_USE_CLOCK},
+  {"mc-rave-equivalence", required_argument, 0, OPT_MC_RAVE_EQUIVALENCE},
+  {"mc-memory",      required_argument, 0, OPT_MC_MEMORY},
+  {"mc-widening",    required_argument, 0, OPT_MC_WIDENING},
+  {"mc-ladders",     no_argument,       0, OPT_MC_LADDERS},
+  {"persistent-cache-entries", required_argument, 0,
+   OPT_PERSISTENT_CACHE_ENTRIES},
+  {"persistent-cache-memory", required_argument, 0,
+   OPT_PERSISTENT_CACHE_MEMORY},
+  {"ponder",         no_argument,       0, OPT_PONDER},
+  {"threads",        required_argument, 0, OPT_THREADS},
   {NULL, 0, NULL, 0}
 };
 
@@ -651,6 +671,65 @@ main(int argc, char *argv[])
 	mc_games_per_level = atoi(gg_optarg);
 	break;
 
+      case OPT_MC_USE_CLOCK:
+	mc_use_clock = 1;
+	break;
+
+      case OPT_MC_RAVE_EQUIVALENCE:
+	mc_rave_equivalence = atoi(gg_optarg);
+	if (mc_rave_equivalence < 0) {
+	  fprintf(stderr, "Invalid RAVE equivalence parameter: %s\n",
+		  gg_optarg);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_MC_MEMORY:
+	mc_memory = atof(gg_optarg);
+	break;
+
+      case OPT_MC_WIDENING:
+	mc_widening = atoi(gg_optarg);
+	if (mc_widening < 0) {
+	  fprintf(stderr, "Invalid progressive widening parameter: %s\n",
+		  gg_optarg);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_MC_LADDERS:
+	mc_ladders = 1;
+	break;
+
+      case OPT_PERSISTENT_CACHE_ENTRIES:
+	persistent_cache_entries = atoi(gg_optarg);
+	if (persistent_cache_entries <= 0) {
+	  fprintf(stderr, "Invalid number of persistent cache entries: %s\n",
+		  gg_optarg);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_PERSISTENT_CACHE_MEMORY:
+	persistent_cache_memory = atof(gg_optarg);
+	if (persistent_cache_memory <= 0.0) {
+	  fprintf(stderr, "Invalid persistent cache memory: %s\n", gg_optarg);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_PONDER:
+	mc_ponder = 1;
+	break;
+
+      case OPT_THREADS:
+	mc_threads = atoi(gg_optarg);
+	if (mc_threads < 1) {
+	  fprintf(stderr, "Invalid number of threads: %s\n", gg_optarg);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
       case OPT_MC_PATTERNS:
 	if (strlen(gg_optarg) >= sizeof(mc_pattern_name)) {
 	  fprintf(stderr, "Too long name given as value to --mc-patterns option.\n");
@@ -1538,6 +1617,13 @@ Experimental options:\n\
    --mc-list-patterns      list names of builtin Monte Carlo patterns\n\
    --mc-patterns <name>    choose a built in Monte Carlo pattern database\n\
    --mc-load-patterns <filename> read Monte Carlo patterns from file\n\
+   --mc-use-clock          time Monte Carlo search by the clock settings\n\
+   --mc-rave-equivalence <n> weigh in AMAF values in Monte Carlo search\n\
+   --mc-memory <megs>      memory for the Monte Carlo search tree\n\
+   --mc-widening <n>       progressive widening in Monte Carlo search\n\
+   --mc-ladders            read ladders in Monte Carlo simulations\n\
+   --ponder                continue Monte Carlo search on opponent's time\n\
+   --threads <n>           number of threads for Monte Carlo search\n\
    --alternate-connections\n\
    --experimental-connections\n\
    --experimental-owl-ext\n\
@@ -1548,6 +1634,8 @@ Experimental options:\n\
 \n\
 Cache size (higher=more memory usage, faster unless swapping occurs):\n\
    -M, --cache-size <megabytes>  RAM cache for read results (default %4.1f Mb)\n\
+   --persistent-cache-entries <n>  entries in each persistent cache\n\
+   --persistent-cache-memory <megabytes>  RAM for persistent caches\n\
 \n\
 Informative Output:\n\
    -v, --version         Display the version and copyright of GNU Go\n\
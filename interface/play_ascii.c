@@ -122,6 +122,9 @@ set_handicap_spots(int boardsize)
   
   memset(hspots, '.', sizeof(hspots));
 
+  if (boardsize < 1 || boardsize > MAX_BOARD)
+    return;
+
   if (boardsize == 5) {
     /* place the outer 4 */
     hspots[1][1] = '+';
@@ -142,7 +145,7 @@ set_handicap_spots(int boardsize)
       hspots[2][boardsize-3] = '+';
       hspots[boardsize-3][boardsize-3] = '+';
     }
-    else {
+    else if (boardsize >= 12) {
       /* Place the outer 4 only. */
       hspots[3][3] = '+';
       hspots[boardsize-4][3] = '+';
@@ -24,6 +24,7 @@
 #include "gnugo.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
@@ -38,10 +39,21 @@
 static int report_uncertainty = 0;
 static int gtp_orientation = 0;
 
+/* Color to ponder for after genmove, EMPTY if pondering is not
+ * called for.
+ */
+static int ponder_color = EMPTY;
+
+/* Nonzero while an mc_analyze command streams its response. */
+static int analysis_running = 0;
+static int analysis_response_started = 0;
+
 static void gtp_print_code(int c);
 static void gtp_print_vertices2(int n, int *moves);
 static void rotate_on_input(int ai, int aj, int *bi, int *bj);
 static void rotate_on_output(int ai, int aj, int *bi, int *bj);
+static void start_background_search(void);
+static void stop_background_search(void);
 
 
 #define DECLARE(func) static int func(char *s)
@@ -101,6 +113,7 @@ DECLARE(gtp_get_komi);
 DECLARE(gtp_get_life_node_counter);
 DECLARE(gtp_get_owl_node_counter);
 DECLARE(gtp_get_random_seed);
+DECLARE(gtp_get_reading_cache_statistics);
 DECLARE(gtp_get_reading_node_counter);
 DECLARE(gtp_get_trymove_counter);
 DECLARE(gtp_gg_genmove);
@@ -119,8 +132,12 @@ DECLARE(gtp_last_move);
 DECLARE(gtp_limit_search);
 DECLARE(gtp_list_commands);
 DECLARE(gtp_list_stones);
+DECLARE(gtp_load_reading_cache);
 DECLARE(gtp_loadsgf);
 DECLARE(gtp_move_influence);
+DECLARE(gtp_mc_analyze);
+DECLARE(gtp_mc_benchmark);
+DECLARE(gtp_mc_dump_tree);
 DECLARE(gtp_move_probabilities);
 DECLARE(gtp_move_reasons);
 DECLARE(gtp_move_uncertainty);
@@ -150,11 +167,13 @@ DECLARE(gtp_report_uncertainty);
 DECLARE(gtp_reset_connection_node_counter);
 DECLARE(gtp_reset_life_node_counter);
 DECLARE(gtp_reset_owl_node_counter);
+DECLARE(gtp_reset_reading_cache_statistics);
 DECLARE(gtp_reset_reading_node_counter);
 DECLARE(gtp_reset_search_mask);
 DECLARE(gtp_reset_trymove_counter);
 DECLARE(gtp_restricted_genmove);
 DECLARE(gtp_same_dragon);
+DECLARE(gtp_save_reading_cache);
 DECLARE(gtp_set_boardsize);
 DECLARE(gtp_set_free_handicap);
 DECLARE(gtp_set_komi);
@@ -174,6 +193,7 @@ DECLARE(gtp_top_moves_black);
 DECLARE(gtp_top_moves_white);
 DECLARE(gtp_tryko);
 DECLARE(gtp_trymove);
+DECLARE(gtp_trymove_benchmark);
 DECLARE(gtp_tune_move_ordering);
 DECLARE(gtp_unconditional_status);
 DECLARE(gtp_undo);
@@ -242,6 +262,7 @@ static struct gtp_command commands[] = {
   {"get_life_node_counter",   gtp_get_life_node_counter},
   {"get_owl_node_counter",    gtp_get_owl_node_counter},
   {"get_random_seed",  	      gtp_get_random_seed},
+  {"get_reading_cache_statistics", gtp_get_reading_cache_statistics},
   {"get_reading_node_counter", gtp_get_reading_node_counter},
   {"get_trymove_counter",     gtp_get_trymove_counter},
   {"gg-undo",                 gtp_gg_undo},
@@ -263,7 +284,11 @@ static struct gtp_command commands[] = {
   {"limit_search",     	      gtp_limit_search},
   {"list_commands",    	      gtp_list_commands},
   {"list_stones",    	      gtp_list_stones},
+  {"load_reading_cache",      gtp_load_reading_cache},
   {"loadsgf",          	      gtp_loadsgf},
+  {"mc_analyze",              gtp_mc_analyze},
+  {"mc_benchmark",            gtp_mc_benchmark},
+  {"mc_dump_tree",            gtp_mc_dump_tree},
   {"move_influence",          gtp_move_influence},
   {"move_probabilities",      gtp_move_probabilities},
   {"move_reasons",            gtp_move_reasons},
@@ -293,11 +318,13 @@ static struct gtp_command commands[] = {
   {"reset_connection_node_counter", gtp_reset_connection_node_counter},
   {"reset_life_node_counter", gtp_reset_life_node_counter},
   {"reset_owl_node_counter",  gtp_reset_owl_node_counter},
+  {"reset_reading_cache_statistics", gtp_reset_reading_cache_statistics},
   {"reset_reading_node_counter", gtp_reset_reading_node_counter},
   {"reset_search_mask",       gtp_reset_search_mask},
   {"reset_trymove_counter",   gtp_reset_trymove_counter},
   {"restricted_genmove",      gtp_restricted_genmove},
   {"same_dragon",    	      gtp_same_dragon},
+  {"save_reading_cache",      gtp_save_reading_cache},
   {"set_free_handicap",       gtp_set_free_handicap},
   {"set_random_seed",  	      gtp_set_random_seed},
   {"set_search_diamond",      gtp_set_search_diamond},
@@ -313,6 +340,7 @@ static struct gtp_command commands[] = {
   {"top_moves_white",         gtp_top_moves_white},
   {"tryko",          	      gtp_tryko},
   {"trymove",          	      gtp_trymove},
+  {"trymove_benchmark",       gtp_trymove_benchmark},
   {"tune_move_ordering",      gtp_tune_move_ordering},
   {"unconditional_status",    gtp_unconditional_status},
   {"undo",                    gtp_undo},
@@ -341,6 +369,7 @@ play_gtp(FILE *gtp_input, FILE *gtp_output, FILE *gtp_dump_commands,
   gtp_internal_set_boardsize(board_size);
   gtp_orientation = gtp_initial_orientation;
   gtp_set_vertex_transform_hooks(rotate_on_input, rotate_on_output);
+  gtp_set_idle_hooks(start_background_search, stop_background_search);
 
   /* Initialize time handling. */
   init_timers();
@@ -1250,6 +1279,41 @@ gtp_popgo(char *s)
   return gtp_success("");
 }
 
+/* Function:  Benchmark trymove() and popgo() from the current position.
+ * Arguments: number of iterations, optionally color to move
+ * Fails:     invalid arguments
+ * Returns:   The way moves are undone in this build, the number of
+ *            trymove()/popgo() pairs and the time per pair.
+ *
+ * Each iteration tries every move and, under each legal one, every
+ * reply. The color to move defaults to the opponent of the last
+ * move, or black on an empty board. Compare builds with and without
+ * SNAPSHOT_UNDO to choose the faster way for a board size.
+ */
+static int
+gtp_trymove_benchmark(char *s)
+{
+  int num_iterations;
+  int color;
+  int n;
+  int num_pairs;
+  double t;
+
+  if (sscanf(s, "%d%n", &num_iterations, &n) < 1 || num_iterations <= 0)
+    return gtp_failure("invalid number of iterations");
+
+  if (!gtp_decode_color(s + n, &color)) {
+    if (get_last_player() == EMPTY)
+      color = BLACK;
+    else
+      color = OTHER_COLOR(get_last_player());
+  }
+
+  t = trymove_benchmark(color, num_iterations, &num_pairs);
+  return gtp_success("%s %d pairs, %.1f ns per pair", undo_strategy_name(),
+		     num_pairs, 1e9 * t / gg_max(num_pairs, 1));
+}
+
 /*********************
  * Caching	     *
  *********************/
@@ -1265,7 +1329,52 @@ gtp_clear_cache(char *s)
 {
   UNUSED(s);
   clear_persistent_caches();
-  reading_cache_clear();
+  reading_cache_clear_all();
+  return gtp_success("");
+}
+
+
+/* Function:  Save the results in the transposition table to a file.
+ * Arguments: filename
+ * Fails:     missing filename or file cannot be written
+ * Returns:   nothing
+ */
+
+static int
+gtp_save_reading_cache(char *s)
+{
+  char filename[GTP_BUFSIZE];
+
+  if (sscanf(s, "%s", filename) < 1)
+    return gtp_failure("missing filename");
+
+  if (!reading_cache_save(filename))
+    return gtp_failure("cannot save reading cache");
+
+  return gtp_success("");
+}
+
+
+/* Function:  Load results saved with save_reading_cache into the
+ *            transposition table. They are kept until replaced or
+ *            until clear_cache.
+ * Arguments: filename
+ * Fails:     missing filename, file cannot be read or was saved with
+ *            other hash values, board size or level
+ * Returns:   nothing
+ */
+
+static int
+gtp_load_reading_cache(char *s)
+{
+  char filename[GTP_BUFSIZE];
+
+  if (sscanf(s, "%s", filename) < 1)
+    return gtp_failure("missing filename");
+
+  if (!reading_cache_load(filename))
+    return gtp_failure("cannot load reading cache");
+
   return gtp_success("");
 }
 
@@ -2488,6 +2597,7 @@ gtp_genmove(char *s)
     return gtp_success("resign");
 
   gnugo_play_move(move, color);
+  ponder_color = OTHER_COLOR(color);
 
   gtp_start_response(GTP_SUCCESS);
   gtp_print_vertex(I(move), J(move));
@@ -3398,6 +3508,57 @@ gtp_get_connection_node_counter(char *s)
 
 
 
+/* Function:  Reset the statistics for the transposition table.
+ * Arguments: none
+ * Fails:     never
+ * Returns:   nothing
+ */
+static int
+gtp_reset_reading_cache_statistics(char *s)
+{
+  UNUSED(s);
+  reading_cache_reset_stats();
+  return gtp_success("");
+}
+
+
+/* Function:  Retrieve the statistics for the transposition table.
+ * Arguments: none
+ * Fails:     never
+ * Returns:   For each routine a line with lookups, hits, trusted hits
+ *            and entered results, followed by lines with counts of
+ *            index collisions and of the ways results were stored,
+ *            the number of stored results for each remaining depth
+ *            and the used and total number of nodes.
+ */
+static int
+gtp_get_reading_cache_statistics(char *s)
+{
+  struct reading_cache_stats cache_stats;
+  int k;
+  UNUSED(s);
+
+  reading_cache_get_stats(&cache_stats);
+  gtp_start_response(GTP_SUCCESS);
+  for (k = 0; k < NUM_CACHE_ROUTINES; k++)
+    gtp_printf("%s %d %d %d %d\n", routine_id_to_string(k),
+	       cache_stats.lookups[k], cache_stats.hits[k],
+	       cache_stats.trusted_hits[k], cache_stats.entered[k]);
+  gtp_printf("collisions %d\n", cache_stats.collisions);
+  gtp_printf("updated %d\n", cache_stats.updated);
+  gtp_printf("deeper_kept %d\n", cache_stats.deeper_kept);
+  gtp_printf("empty_used %d\n", cache_stats.empty_used);
+  gtp_printf("replaced %d\n", cache_stats.replaced);
+  gtp_printf("depths");
+  for (k = 0; k < (int) (sizeof(cache_stats.depths)
+			 / sizeof(cache_stats.depths[0])); k++)
+    gtp_printf(" %d", cache_stats.depths[k]);
+  gtp_printf("\nnodes %d %d", cache_stats.used_nodes, cache_stats.num_nodes);
+  return gtp_finish_response();
+}
+
+
+
 /*********
  * debug *
  *********/
@@ -3732,6 +3893,164 @@ gtp_move_uncertainty(char *s)
 }
 
 
+/* Report function for gtp_mc_analyze(), called from the analysis
+ * thread. The first call starts the response.
+ */
+static void
+report_mc_analysis(void)
+{
+  struct mc_analysis_move moves[BOARDMAX];
+  int num_moves = uct_get_analysis(moves, BOARDMAX);
+  int k;
+  int m;
+
+  if (!analysis_response_started) {
+    gtp_start_response(GTP_SUCCESS);
+    gtp_printf("\n");
+    analysis_response_started = 1;
+  }
+
+  if (num_moves == 0)
+    return;
+
+  for (k = 0; k < num_moves; k++) {
+    if (k > 0)
+      gtp_printf(" ");
+    gtp_printf("info move ");
+    gtp_print_vertex(I(moves[k].move), J(moves[k].move));
+    gtp_printf(" games %d winrate %.4f scoremean %.1f scorestddev %.1f pv",
+	       moves[k].games, moves[k].winrate, moves[k].score_mean,
+	       moves[k].score_stddev);
+    for (m = 0; m < moves[k].pv_length; m++) {
+      gtp_printf(" ");
+      gtp_print_vertex(I(moves[k].pv[m]), J(moves[k].pv[m]));
+    }
+  }
+  gtp_printf("\n");
+  fflush(gtp_output_file);
+}
+
+
+/* Function:  Analyze the position with the Monte Carlo search until
+ *            the next command arrives.
+ * Arguments: color to move, interval in centiseconds
+ * Fails:     invalid arguments, no thread support
+ * Returns:   One line per interval, listing the moves of the search
+ *            tree root by decreasing number of games as
+ *            "info move <vertex> games <n> winrate <w> scoremean <s>
+ *            scorestddev <d> pv <vertices>", repeated for each move.
+ *
+ * The response is ended with an empty line when the next command
+ * arrives. The win rates and scores are for the color to move.
+ */
+static int
+gtp_mc_analyze(char *s)
+{
+  int color;
+  int interval;
+  int n;
+
+  n = gtp_decode_color(s, &color);
+  if (!n)
+    return gtp_failure("invalid color");
+
+  if (sscanf(s + n, "%d", &interval) < 1 || interval <= 0)
+    return gtp_failure("invalid interval");
+
+  analysis_response_started = 0;
+  if (!uct_analyze_start(color, interval / 100.0, report_mc_analysis))
+    return gtp_failure("analysis needs thread support");
+
+  /* The response is written by report_mc_analysis() and finished
+   * when the next command stops the analysis.
+   */
+  analysis_running = 1;
+  return GTP_OK;
+}
+
+
+/* Function:  Benchmark Monte Carlo playouts from the current position
+ *            with each builtin Monte Carlo pattern database.
+ * Arguments: number of playouts, optionally color to move
+ * Fails:     invalid arguments
+ * Returns:   One row per pattern database with playouts per second,
+ *            average playout length, and the percentage of the
+ *            playout time spent in mc_play_move(),
+ *            mc_update_move_values() and mc_generate_random_move().
+ *
+ * The color to move defaults to the opponent of the last move, or
+ * black on an empty board. The pattern values in use are restored
+ * afterwards.
+ */
+static int
+gtp_mc_benchmark(char *s)
+{
+  int num_playouts;
+  int color;
+  int n;
+  int k;
+  const char *name;
+  unsigned int *saved_values;
+
+  if (sscanf(s, "%d%n", &num_playouts, &n) < 1 || num_playouts <= 0)
+    return gtp_failure("invalid number of playouts");
+
+  if (!gtp_decode_color(s + n, &color)) {
+    if (get_last_player() == EMPTY)
+      color = BLACK;
+    else
+      color = OTHER_COLOR(get_last_player());
+  }
+
+  saved_values = malloc(mc_get_size_of_pattern_values_table()
+			* sizeof(*saved_values));
+  if (!saved_values)
+    return gtp_failure("out of memory");
+  mc_get_patterns(saved_values);
+
+  gtp_start_response(GTP_SUCCESS);
+  for (k = 0; (name = mc_pattern_database_name(k)) != NULL; k++) {
+    struct mc_benchmark_result result;
+    double total;
+
+    choose_mc_patterns(name);
+    mc_benchmark(color, num_playouts, &result);
+    total = gg_max(result.total_time, 1e-6);
+    gtp_printf("%s %.1f playouts/s, %.1f moves, mc_play_move %.1f%%, "
+	       "mc_update_move_values %.1f%%, mc_generate_random_move %.1f%%\n",
+	       name, result.playouts_per_second, result.average_length,
+	       100.0 * result.play_move_time / total,
+	       100.0 * result.update_move_values_time / total,
+	       100.0 * result.generate_random_move_time / total);
+  }
+
+  mc_init_patterns(saved_values);
+  free(saved_values);
+
+  return gtp_finish_response();
+}
+
+
+/* Function:  Write the Monte Carlo search tree from the last search
+ *            to a file in binary format, for the uct_inspect utility.
+ * Arguments: filename
+ * Fails:     missing filename, no search tree, file not writable
+ * Returns:   nothing
+ */
+static int
+gtp_mc_dump_tree(char *s)
+{
+  char filename[GTP_BUFSIZE];
+
+  if (sscanf(s, "%s", filename) < 1)
+    return gtp_failure("missing filename");
+
+  if (!uct_dump_search_tree(filename))
+    return gtp_failure("cannot dump search tree");
+
+  return gtp_success("");
+}
+
 
 /* Function:  Return information about the followup influence after a move.
  * Arguments: move, what information
@@ -4339,6 +4658,35 @@ rotate_on_output(int ai, int aj, int *bi, int *bj)
 }
 
 
+/*********************
+ * background search *
+ *********************/
+
+/* Idle hooks for gtp_main_loop(). After genmove, keep the Monte Carlo
+ * search going for the opponent's position until the next command
+ * arrives. A running mc_analyze is stopped by the next command as
+ * well, which also ends its response.
+ */
+static void
+start_background_search(void)
+{
+  if (mc_ponder && use_monte_carlo_genmove && ponder_color != EMPTY)
+    uct_ponder_start(ponder_color);
+  ponder_color = EMPTY;
+}
+
+static void
+stop_background_search(void)
+{
+  uct_ponder_stop();
+  if (analysis_running) {
+    uct_analyze_stop();
+    gtp_printf("\n");
+    analysis_running = 0;
+  }
+}
+
+
 /***************
  * random seed *
  ***************/
@@ -761,8 +761,11 @@ store_pattern_if_winner(struct invariant_hash *pre,
 	  }
 	}
       winning_moves[k].pattern[m][n] = '*';
-      /* Add ? in areas far away from the move. */
-      if (half_board_patterns == 1 && move_number > 3 && board_size == 19)
+      /* Add ? in areas far away from the move. The regions are laid
+       * out for 19x19 and cannot occur when compiled for smaller boards.
+       */
+      if (half_board_patterns == 1 && move_number > 3
+	  && MAX_BOARD >= 19 && board_size == 19)
         region = find_region(m, n);
       if (region != 8) {
         for (i = 0; i < board_size; i++) {
@@ -1589,6 +1592,10 @@ main(int argc, char *argv[])
 	    board_size);
     exit(EXIT_FAILURE);
   }
+  if (board_size < MIN_BOARD || board_size > MAX_BOARD) {
+    fprintf(stderr, "Fatal error, unsupported boardsize: %d.\n", board_size);
+    exit(EXIT_FAILURE);
+  }
   if (board_size < 9 || board_size > 19)
     fprintf(stderr, "Warning: strange boardsize: %d.\n", board_size);
   
@@ -70,7 +70,7 @@ static int rand_initialized = 0;
  */
 
 static void
-iterate_tgfsr(void)
+iterate_tgfsr(unsigned int *x)
 {
   int i;
   for (i = 0; i < N - m; i++)
@@ -80,27 +80,48 @@ iterate_tgfsr(void)
 }
 
 
+/* Temper one word of the internal state into an output value. */
+
+static unsigned int
+temper(unsigned int y)
+{
+  y ^= ((y << s) & b);
+  y ^= ((y << t) & c);
+#if BIG_UINT
+  y &= 0xffffffffU;
+#endif
+  return y;
+}
+
+
 /* Produce a random number from the next word of the internal state.
  */
 
 static unsigned int
 next_rand(void)
 {
-  int y;
   if (!rand_initialized) {
     assert(rand_initialized); /* Abort. */
     gg_srand(1);              /* Initialize silently if assertions disabled. */
   }
   if (++k == N) {
-    iterate_tgfsr();
+    iterate_tgfsr(x);
     k = 0;
   }
-  y = x[k] ^ ((x[k] << s) & b);
-  y ^= ((y << t) & c);
-#if BIG_UINT
-  y &= 0xffffffffU;
-#endif
-  return y;
+  return temper(x[k]);
+}
+
+
+/* Same as next_rand() but working on an explicitly given state. */
+
+static unsigned int
+next_rand_r(struct gg_rand_state *state)
+{
+  if (++state->k == N) {
+    iterate_tgfsr(state->x);
+    state->k = 0;
+  }
+  return temper(state->x[state->k]);
 }
 
 
@@ -117,18 +138,31 @@ next_rand(void)
 
 void
 gg_srand(unsigned int seed)
+{
+  struct gg_rand_state state;
+  gg_srand_r(&state, seed);
+  gg_set_rand_state(&state);
+  rand_initialized = 1;
+}
+
+
+/* Seed an explicitly given random number generator state in the same
+ * way as gg_srand() seeds the global one.
+ */
+
+void
+gg_srand_r(struct gg_rand_state *state, unsigned int seed)
 {
   int i;
   for (i = 0; i < N; i++) {
 #if BIG_UINT
     seed &= 0xffffffffU;
 #endif
-    x[i] = seed;
+    state->x[i] = seed;
     seed *= 1313;
     seed += 88897;
   }
-  k = N-1; /* Force an immediate iteration of the TGFSR. */
-  rand_initialized = 1;
+  state->k = N-1; /* Force an immediate iteration of the TGFSR. */
 }
 
 
@@ -167,6 +201,25 @@ gg_drand(void)
 }
 
 
+/* Reentrant versions of gg_urand() and gg_drand(), drawing numbers
+ * from a state owned by the caller. These can be used concurrently
+ * from multiple threads as long as each thread has its own state.
+ */
+
+unsigned int
+gg_urand_r(struct gg_rand_state *state)
+{
+  return next_rand_r(state);
+}
+
+
+double
+gg_drand_r(struct gg_rand_state *state)
+{
+  return next_rand_r(state) * 2.328306436538696e-10;
+}
+
+
 /* Retrieve the internal state of the random generator.
  */
 
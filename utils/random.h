@@ -69,6 +69,11 @@ unsigned int gg_urand(void);
  */
 double gg_drand(void);
 
+/* Reentrant variants working on a state owned by the caller. */
+void gg_srand_r(struct gg_rand_state *state, unsigned int seed);
+unsigned int gg_urand_r(struct gg_rand_state *state);
+double gg_drand_r(struct gg_rand_state *state);
+
 /* Retrieve the internal state of the random generator. */
 void gg_get_rand_state(struct gg_rand_state *state);
 